@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "arena.h"
+
+// From linux/mman.h, which older C libraries do not expose
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+HugePageSize hugePageSize = HugePageSize::TransparentHugePages;
+size_t memoryCap = 0;
+
+size_t arenaSize(size_t bytes) {
+  return (bytes + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+}
+
+// The granularity the arena is mapped (and released) in
+size_t getPageBytes(HugePageSize size) {
+  switch (size) {
+    case HugePageSize::HugePages2MB:
+      return 1UL << 21;
+    case HugePageSize::HugePages1GB:
+      return 1UL << 30;
+    default:
+      return sysconf(_SC_PAGESIZE);
+  }
+}
+
+size_t arenaMappedSize(size_t capacity) {
+  size_t pageBytes = getPageBytes(hugePageSize);
+  return (capacity + pageBytes - 1) & ~(pageBytes - 1);
+}
+
+Arena createArena(size_t capacity) {
+  Arena arena;
+  arena.used = 0;
+  arena.peakUsed = 0;
+  arena.pageSize = hugePageSize;
+  void* mapping = MAP_FAILED;
+  if (hugePageSize == HugePageSize::HugePages2MB || hugePageSize == HugePageSize::HugePages1GB) {
+    arena.capacity = arenaMappedSize(capacity);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (hugePageSize == HugePageSize::HugePages2MB ? MAP_HUGE_2MB : MAP_HUGE_1GB);
+    mapping = mmap(NULL, arena.capacity, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapping == MAP_FAILED) {
+      // Explicit huge pages have to be reserved beforehand (see /proc/sys/vm/nr_hugepages)
+      std::cout << "Could not map " << hugePageSizeToString(hugePageSize) << " huge pages (" << strerror(errno) << "), using transparent huge pages instead" << std::endl;
+      arena.pageSize = HugePageSize::TransparentHugePages;
+    }
+  }
+  if (mapping == MAP_FAILED) {
+    size_t pageBytes = getPageBytes(HugePageSize::NoHugePages);
+    arena.capacity = (capacity + pageBytes - 1) & ~(pageBytes - 1);
+    mapping = mmap(NULL, arena.capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+      std::cout << "Could not map " << arena.capacity << " bytes: " << strerror(errno) << std::endl;
+      exit(1);
+    }
+    if (arena.pageSize == HugePageSize::TransparentHugePages) {
+      madvise(mapping, arena.capacity, MADV_HUGEPAGE);
+    }
+  }
+  arena.base = (uint8_t*) mapping;
+  return arena;
+}
+
+void freeArena(Arena* arena) {
+  munmap(arena->base, arena->capacity);
+  arena->base = NULL;
+  arena->capacity = 0;
+  arena->used = 0;
+  arena->peakUsed = 0;
+  arena->allocations.clear();
+}
+
+void* arenaAllocate(Arena* arena, size_t bytes, const char* subsystem) {
+  size_t size = arenaSize(bytes);
+  if (arena->used + size > arena->capacity) {
+    // The arena is always sized up front, so this is a bug rather than running out of memory
+    std::cout << "Arena overflow allocating " << bytes << " bytes for " << subsystem << std::endl;
+    abort();
+  }
+  void* allocation = arena->base + arena->used;
+  arena->allocations.push_back({subsystem, arena->used, size});
+  arena->used += size;
+  arena->peakUsed = std::max(arena->peakUsed, arena->used);
+  return allocation;
+}
+
+void arenaRelease(Arena* arena, size_t mark) {
+  while (!arena->allocations.empty() && arena->allocations.back().offset >= mark) {
+    arena->allocations.pop_back();
+  }
+  arena->used = mark;
+  // Only whole pages past the mark can be given back
+  size_t pageBytes = getPageBytes(arena->pageSize);
+  size_t releaseStart = (mark + pageBytes - 1) & ~(pageBytes - 1);
+  if (releaseStart < arena->capacity) {
+    madvise(arena->base + releaseStart, arena->capacity - releaseStart, MADV_DONTNEED);
+  }
+}
+
+std::string formatBytes(size_t bytes) {
+  char text[32];
+  snprintf(text, sizeof(text), "%.2f MiB", bytes / (1024.0 * 1024.0));
+  return text;
+}
+
+void printArenaReport(Arena arena, const char* name) {
+  std::cout << name << " memory (" << hugePageSizeToString(arena.pageSize) << " pages):" << std::endl;
+  // Summed in the order the subsystems were first allocated
+  std::vector<std::string> subsystems;
+  std::map<std::string, size_t> subsystemBytes;
+  for (ArenaAllocation allocation : arena.allocations) {
+    if (subsystemBytes.count(allocation.subsystem) == 0) {
+      subsystems.push_back(allocation.subsystem);
+    }
+    subsystemBytes[allocation.subsystem] += allocation.bytes;
+  }
+  for (std::string subsystem : subsystems) {
+    std::cout << "  " << subsystem << ": " << formatBytes(subsystemBytes[subsystem]) << std::endl;
+  }
+  std::cout << "  Setup only (released): " << formatBytes(arena.peakUsed - arena.used) << std::endl;
+  // Explicit huge pages can round the arena up a long way
+  if (arena.pageSize == HugePageSize::HugePages2MB || arena.pageSize == HugePageSize::HugePages1GB) {
+    std::cout << "  Rounding up to whole pages: " << formatBytes(arena.capacity - arena.peakUsed) << std::endl;
+  }
+  std::cout << "  Total: " << formatBytes(arena.capacity) << std::endl;
+}
+
+bool checkMemoryCap(size_t bytes, const char* name) {
+  if (memoryCap != 0 && bytes > memoryCap) {
+    std::cout << name << " needs " << formatBytes(bytes) << ", which is over the memory cap of " << formatBytes(memoryCap) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+const char* hugePageSizeToString(HugePageSize size) {
+  switch (size) {
+    case HugePageSize::TransparentHugePages:
+      return "transparent";
+    case HugePageSize::HugePages2MB:
+      return "2mb";
+    case HugePageSize::HugePages1GB:
+      return "1gb";
+    default:
+      return "none";
+  }
+}
+
+bool parseHugePageSize(const char* name, HugePageSize* size) {
+  for (int i = HugePageSize::NoHugePages; i <= HugePageSize::HugePages1GB; i++) {
+    if (strcmp(name, hugePageSizeToString((HugePageSize) i)) == 0) {
+      *size = (HugePageSize) i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Every arena allocation is aligned to a cache line, which is more than FFTW needs for its SIMD codelets
+#define ARENA_ALIGNMENT 64
+
+enum HugePageSize {
+  NoHugePages,
+  // Transparent huge pages, which need no setup but are not guaranteed
+  TransparentHugePages,
+  HugePages2MB,
+  HugePages1GB
+};
+
+// What new arenas are backed by, set with --huge-pages=
+extern HugePageSize hugePageSize;
+
+// The most memory (in bytes) that the engine may use, set with --memory-cap=, or 0 if there is no limit
+extern size_t memoryCap;
+
+struct ArenaAllocation {
+  const char* subsystem;
+  size_t offset;
+  size_t bytes;
+};
+
+// A single mapping which memory is carved from in order. It can be released back to an earlier point
+// (for buffers which are only needed during setup), and is unmapped all at once
+struct Arena {
+  uint8_t* base;
+  size_t capacity;
+  size_t used;
+  // The most that has been in use at once, including buffers which have since been released
+  size_t peakUsed;
+  // How the arena is actually backed, as huge pages may be unavailable
+  HugePageSize pageSize;
+  std::vector<ArenaAllocation> allocations;
+};
+
+// Rounds a size up to what it takes up in an arena
+size_t arenaSize(size_t bytes);
+
+// How much an arena of the given capacity actually maps, once rounded up to whole pages of hugePageSize. This is
+// what counts against the memory cap, as 1GB pages can round a small arena up a long way
+size_t arenaMappedSize(size_t capacity);
+
+Arena createArena(size_t capacity);
+
+void freeArena(Arena* arena);
+
+// Carves bytes out of the arena, recording them against subsystem for the memory report
+void* arenaAllocate(Arena* arena, size_t bytes, const char* subsystem);
+
+// Frees everything allocated since used was mark, and gives the pages back to the OS
+void arenaRelease(Arena* arena, size_t mark);
+
+// As MiB, to two decimal places
+std::string formatBytes(size_t bytes);
+
+// Prints how many bytes each subsystem is using
+void printArenaReport(Arena arena, const char* name);
+
+// Returns false if bytes is more than memoryCap, saying what it was needed for
+bool checkMemoryCap(size_t bytes, const char* name);
+
+const char* hugePageSizeToString(HugePageSize size);
+
+// Returns false if the name is not one of "none", "transparent", "2mb" or "1gb"
+bool parseHugePageSize(const char* name, HugePageSize* size);
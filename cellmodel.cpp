@@ -0,0 +1,199 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "cellmodel.h"
+#include "cells.h"
+
+CellModel cellModel = createDefaultCellModel();
+
+// Recalculates the quiescent table, after the other tables have changed
+void updateQuiescence(CellModel* model) {
+  for (uint type = 0; type < MAX_CELL_TYPES; type++) {
+    for (uint state = 0; state < MAX_CELL_STATES; state++) {
+      uint8_t packed = (type << 4) | state;
+      // With no active cells nearby, the neighbour count is 0 (up to rounding errors from the FFTs), so a cell
+      // which fires on a count that low is never quiescent
+      bool isStable = model->transitions[0][packed] == packed && (model->thresholds[type] >= 0.5 || model->transitions[1][packed] == packed);
+      model->quiescent[packed] = type < model->numTypes && isStable && model->contributions[packed] == 0;
+    }
+  }
+}
+
+uint addCellType(CellModel* model, const char* name, float threshold, bool countsAsNeighbour) {
+  uint type = model->numTypes;
+  model->numTypes++;
+  snprintf(model->typeNames[type], MAX_CELL_TYPE_NAME, "%s", name);
+  model->thresholds[type] = threshold;
+  for (uint state = 0; state < MAX_CELL_STATES; state++) {
+    uint8_t packed = (type << 4) | state;
+    model->transitions[0][packed] = packed;
+    model->transitions[1][packed] = packed;
+    model->contributions[packed] = countsAsNeighbour ? state : 0;
+  }
+  updateQuiescence(model);
+  return type;
+}
+
+void addTransition(CellModel* model, uint type, uint firstState, uint lastState, TransitionCondition condition, uint newType, int newState, bool relativeState) {
+  for (uint state = firstState; state <= lastState; state++) {
+    uint nextState = relativeState ? state + newState : newState;
+    uint8_t packed = (newType << 4) | nextState;
+    if (condition != TransitionCondition::AboveThreshold) {
+      model->transitions[0][(type << 4) | state] = packed;
+    }
+    if (condition != TransitionCondition::BelowThreshold) {
+      model->transitions[1][(type << 4) | state] = packed;
+    }
+  }
+  updateQuiescence(model);
+}
+
+// Empties a model. The lookup tables are still fully defined for the unused types, with every state staying the
+// same and contributing nothing, so that a cell of an undeclared type never turns into another type
+void clearCellModel(CellModel* model) {
+  model->numTypes = 0;
+  for (uint packed = 0; packed < MAX_CELL_TYPES * MAX_CELL_STATES; packed++) {
+    model->transitions[0][packed] = packed;
+    model->transitions[1][packed] = packed;
+  }
+  memset(model->contributions, 0, sizeof(model->contributions));
+  memset(model->quiescent, 0, sizeof(model->quiescent));
+  memset(model->thresholds, 0, sizeof(model->thresholds));
+}
+
+CellModel createDefaultCellModel() {
+  CellModel model;
+  clearCellModel(&model);
+  uint pacemaker = addCellType(&model, "Pacemaker Cell", AP_THRESHOLD, true);
+  uint tissue = addCellType(&model, "Normal Cell", AP_THRESHOLD, true);
+  uint restingTissue = addCellType(&model, "Resting Cell", AP_THRESHOLD, false);
+  uint lastState = MAX_CELL_STATES - 1;
+  // Pacemakers fire again as soon as their action potential ends
+  addTransition(&model, pacemaker, 2, lastState, TransitionCondition::AnyCount, pacemaker, -1, true);
+  addTransition(&model, pacemaker, 0, 1, TransitionCondition::AnyCount, pacemaker, AP_DURATION, false);
+  // Tissue fires when its neighbours are active enough, and then rests once its action potential ends
+  addTransition(&model, tissue, 2, lastState, TransitionCondition::AnyCount, tissue, -1, true);
+  addTransition(&model, tissue, 1, 1, TransitionCondition::AnyCount, restingTissue, REST_DURATION, false);
+  addTransition(&model, tissue, 0, 0, TransitionCondition::AboveThreshold, tissue, AP_DURATION, false);
+  // Resting tissue becomes normal tissue again (and so can fire straight away) once it has rested
+  addTransition(&model, restingTissue, 2, lastState, TransitionCondition::AnyCount, restingTissue, -1, true);
+  addTransition(&model, restingTissue, 0, 1, TransitionCondition::BelowThreshold, tissue, 0, false);
+  addTransition(&model, restingTissue, 0, 1, TransitionCondition::AboveThreshold, tissue, AP_DURATION, false);
+  return model;
+}
+
+int findCellType(CellModel* model, const char* name) {
+  for (int i = 0; i < model->numTypes; i++) {
+    if (strcmp(model->typeNames[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Parses a state, or a range of states such as 2-15
+bool parseStateRange(const std::string& text, uint* firstState, uint* lastState) {
+  if (sscanf(text.c_str(), "%u-%u", firstState, lastState) == 2) {
+    return *firstState <= *lastState && *lastState < MAX_CELL_STATES;
+  }
+  if (sscanf(text.c_str(), "%u", firstState) == 1) {
+    *lastState = *firstState;
+    return *firstState < MAX_CELL_STATES;
+  }
+  return false;
+}
+
+// Parses a new state, which is either a number, or relative to the current state (i.e. state, state-1, state+2)
+bool parseNewState(const std::string& text, int* newState, bool* relativeState) {
+  if (text.compare(0, 5, "state") == 0) {
+    *relativeState = true;
+    *newState = text.size() == 5 ? 0 : atoi(text.c_str() + 5);
+    return text.size() == 5 || text[5] == '-' || text[5] == '+';
+  }
+  *relativeState = false;
+  return sscanf(text.c_str(), "%d", newState) == 1 && *newState >= 0 && *newState < MAX_CELL_STATES;
+}
+
+bool readCellModelFromFile(const char* fileName, CellModel* model) {
+  std::ifstream inputStream(fileName);
+  if (!inputStream.is_open()) {
+    std::cout << "Could not open cell model " << fileName << std::endl;
+    return false;
+  }
+  clearCellModel(model);
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(inputStream, line)) {
+    lineNumber++;
+    std::istringstream lineStream(line);
+    std::string first;
+    if (!(lineStream >> first) || first[0] == '#') {
+      continue;
+    }
+    if (first == "type") {
+      // type <name> <threshold> [counts]
+      std::string name;
+      float threshold;
+      std::string counts;
+      if (!(lineStream >> name >> threshold) || name.size() >= MAX_CELL_TYPE_NAME) {
+        std::cout << fileName << ":" << lineNumber << ": expected type <name> <threshold> [counts]" << std::endl;
+        return false;
+      }
+      if (model->numTypes == MAX_CELL_TYPES) {
+        std::cout << fileName << ":" << lineNumber << ": at most " << MAX_CELL_TYPES << " types are supported" << std::endl;
+        return false;
+      }
+      lineStream >> counts;
+      addCellType(model, name.c_str(), threshold, counts == "counts");
+      continue;
+    }
+    // <type> <state or first-last> <below|above|any> <new type> <new state>
+    std::string stateText;
+    std::string conditionText;
+    std::string newTypeName;
+    std::string newStateText;
+    lineStream >> stateText >> conditionText >> newTypeName >> newStateText;
+    int type = findCellType(model, first.c_str());
+    int newType = findCellType(model, newTypeName.c_str());
+    uint firstState;
+    uint lastState;
+    int newState;
+    bool relativeState;
+    TransitionCondition condition;
+    if (conditionText == "below") {
+      condition = TransitionCondition::BelowThreshold;
+    }
+    else if (conditionText == "above") {
+      condition = TransitionCondition::AboveThreshold;
+    }
+    else if (conditionText == "any") {
+      condition = TransitionCondition::AnyCount;
+    }
+    else {
+      std::cout << fileName << ":" << lineNumber << ": the condition must be below, above or any" << std::endl;
+      return false;
+    }
+    if (type == -1 || newType == -1) {
+      std::cout << fileName << ":" << lineNumber << ": unknown cell type" << std::endl;
+      return false;
+    }
+    if (!parseStateRange(stateText, &firstState, &lastState) || !parseNewState(newStateText, &newState, &relativeState)) {
+      std::cout << fileName << ":" << lineNumber << ": states must be between 0 and " << MAX_CELL_STATES - 1 << std::endl;
+      return false;
+    }
+    if (relativeState && ((int) firstState + newState < 0 || (int) lastState + newState >= MAX_CELL_STATES)) {
+      std::cout << fileName << ":" << lineNumber << ": the new state is out of range" << std::endl;
+      return false;
+    }
+    addTransition(model, type, firstState, lastState, condition, newType, newState, relativeState);
+  }
+  if (model->numTypes == 0) {
+    std::cout << fileName << ": the model has no cell types" << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <sys/types.h>
+// Types and states are packed into a byte as (type << 4) | state for the lookup tables, so these cannot be raised
+#define MAX_CELL_TYPES 8
+#define MAX_CELL_STATES 16
+#define MAX_CELL_TYPE_NAME 32
+
+// Which neighbour counts a transition applies to
+enum TransitionCondition {
+  BelowThreshold,
+  AboveThreshold,
+  AnyCount
+};
+
+// A cell model, i.e. the rules for how each type of cell changes state.
+// Every step, a cell's next type and state are looked up from its current type, state, and whether its
+// neighbour count is above its type's threshold
+struct CellModel {
+  uint numTypes;
+  char typeNames[MAX_CELL_TYPES][MAX_CELL_TYPE_NAME];
+  // The neighbour count a cell of each type needs to be above threshold
+  float thresholds[MAX_CELL_TYPES];
+  // The next (type << 4) | state, indexed by [aboveThreshold][(type << 4) | state]
+  alignas(64) uint8_t transitions[2][MAX_CELL_TYPES * MAX_CELL_STATES];
+  // How much a cell counts towards its neighbours' counts, indexed by (type << 4) | state
+  alignas(64) uint8_t contributions[MAX_CELL_TYPES * MAX_CELL_STATES];
+  // 1 if a cell stays the same and contributes nothing unless a neighbour is active, indexed by (type << 4) | state.
+  // Regions made up entirely of these cells do not need updating (see TileActivity)
+  alignas(64) uint8_t quiescent[MAX_CELL_TYPES * MAX_CELL_STATES];
+};
+
+// The model used by updateCellsArea
+extern CellModel cellModel;
+
+// Adds a type whose cells count towards their neighbours by their state (if countsAsNeighbour), returning its index.
+// Every state of the new type initially stays the same from step to step
+uint addCellType(CellModel* model, const char* name, float threshold, bool countsAsNeighbour);
+
+// Sets the transition of a type's states from firstState to lastState. If relativeState, then newState is added
+// to the cell's current state, and otherwise it is the new state
+void addTransition(CellModel* model, uint type, uint firstState, uint lastState, TransitionCondition condition, uint newType, int newState, bool relativeState);
+
+// Pacemaker, tissue and resting tissue cells, as used by CellType
+CellModel createDefaultCellModel();
+
+// Reads a cell model from a text file (see models/fibrosis.model for the format).
+// Returns false, after printing the problem, if the file is invalid
+bool readCellModelFromFile(const char* fileName, CellModel* model);
+
+// Returns the index of the type with the given name, or -1 if there is none
+int findCellType(CellModel* model, const char* name);
@@ -11,7 +11,6 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cstring>
-#include <forward_list>
 #include <fstream>
 #include <immintrin.h>
 #include <iostream>
@@ -19,23 +18,19 @@
 #include <x86intrin.h>
 #include <fftw3.h>
 #include "cells.h"
+#include "cellmodel.h"
+#include "tiles.h"
 
 uint getSizeOfData(Cells data) {
   return sizeof(uint) * 3 + sizeof(Cell) * data.height * data.width + (sizeof(float) * 2 + sizeof(uint)) * data.numOrientations;
 }
 
 const char* cellTypeToString(CellType type) {
-  switch (type) {
-    case CellType::Tissue:
-      return "Normal Cell";
-    case CellType::Pacemaker:
-      return "Pacemaker Cell";
-    case CellType::RestingTissue:
-      return "Resting Cell";
-    default:
-      std::cout << "ERROR!!! Unkown Cell Type Encountered";
-      return NULL;
+  if (type >= cellModel.numTypes) {
+    std::cout << "ERROR!!! Unkown Cell Type Encountered";
+    return NULL;
   }
+  return cellModel.typeNames[type];
 }
 
 unsigned char* serializeCells(Cells currentState) {
@@ -96,6 +91,7 @@ Cells readCells(unsigned char* serializedData) {
   }
   cells.cells = new Cell[cells.height * cells.width];
   cells.orientations = new Orientation[cells.numOrientations];
+  cells.boundaryMode = BoundaryMode::Periodic;
   memcpy(cells.cells, &serializedData[index], sizeof(Cell) * cells.width * cells.height);
   index += sizeof(Cell) * cells.width * cells.height;
   for (int i = 0; i < cells.numOrientations; i++) {
@@ -111,21 +107,133 @@ Cells readCells(unsigned char* serializedData) {
       index++;
     }
     cells.orientations[i].yDir = *((float*) &temp);
-    cells.orientations[i].cellCount = 0;
-    for (int j = 0; j < sizeof(uint); j++) {
-      cells.orientations[i].cellCount = cells.orientations[i].cellCount | (serializedData[index] << j * 8);
-      index++;
-    }
-    // Rebuilds the orientation.cells forward_list
-    for (int k = 0; k < cells.height * cells.width; k++) {
-      if (cells.cells[k].orientationIndex == i) {
-        cells.orientations[i].cells.push_front(&cells.cells[k]);
+    // Only kept for the file format, as it is recounted when the index is built
+    index += sizeof(uint);
+  }
+  cells.orientationOffsets = new uint[cells.numOrientations + 1];
+  cells.orientationCells = new uint[cells.height * cells.width];
+  buildOrientationIndex(&cells);
+  return cells;
+}
+
+uint nextFastFFTSize(uint n) {
+  for (uint size = n; ; size++) {
+    uint remainder = size;
+    for (uint factor : {2, 3, 5, 7}) {
+      while (remainder % factor == 0) {
+        remainder /= factor;
       }
     }
+    if (remainder == 1) {
+      return size;
+    }
+  }
+}
+
+int wrapCoordinate(int coordinate, uint size, BoundaryMode mode) {
+  if (mode == BoundaryMode::Insulated) {
+    return (coordinate >= 0 && coordinate < (int) size) ? coordinate : -1;
+  }
+  // Unlike %, this also works for negative coordinates
+  int wrapped = coordinate % (int) size;
+  return wrapped < 0 ? wrapped + size : wrapped;
+}
+
+Cells createDefaultCells(uint width, uint height) {
+  Cells cells;
+  cells.width = width;
+  cells.height = height;
+  cells.cells = new Cell[cells.height * cells.width];
+  cells.numOrientations = 1;
+  cells.orientations = new Orientation[1];
+  cells.orientations[0].xDir = 1.0;
+  cells.orientations[0].yDir = 0.0;
+  cells.orientations[0].cellCount = cells.height * cells.width;
+  cells.orientationOffsets = new uint[2];
+  cells.orientationCells = new uint[cells.height * cells.width];
+  cells.orientationOffsets[0] = 0;
+  cells.orientationOffsets[1] = cells.height * cells.width;
+  cells.boundaryMode = BoundaryMode::Periodic;
+  // Initialize all cells to be inactive normal tissue
+  for (int i = 0; i < cells.height * cells.width; i++) {
+    cells.cells[i].type = CellType::Tissue;
+    cells.cells[i].state = 0;
+    cells.cells[i].orientationIndex = 0;
+    cells.orientationCells[i] = i;
   }
   return cells;
 }
 
+void freeCells(Cells cells) {
+  delete[] cells.cells;
+  delete[] cells.orientations;
+  delete[] cells.orientationOffsets;
+  delete[] cells.orientationCells;
+}
+
+// Counts how many of the cells in [start, end) have each orientation
+void countOrientations(Cells* cells, uint start, uint end, uint* counts) {
+  for (uint i = start; i < end; i++) {
+    uint orientation = cells->cells[i].orientationIndex;
+    if (orientation < cells->numOrientations) {
+      counts[orientation]++;
+    }
+  }
+}
+
+// Writes the indices of the cells in [start, end) into each orientation's part of the index, starting at positions
+void scatterOrientations(Cells* cells, uint start, uint end, uint* positions) {
+  for (uint i = start; i < end; i++) {
+    uint orientation = cells->cells[i].orientationIndex;
+    if (orientation < cells->numOrientations) {
+      cells->orientationCells[positions[orientation]++] = i;
+    }
+  }
+}
+
+void buildOrientationIndex(Cells* cells) {
+  // A counting sort, with each thread counting, then placing, a contiguous range of the cells. The ranges are placed
+  // in order, so each orientation's cells come out in increasing order
+  uint numCells = cells->width * cells->height;
+  uint numOrientations = cells->numOrientations;
+  uint* counts = new uint[NUM_THREADS * numOrientations]();
+  std::thread threads[NUM_THREADS];
+  uint delta = numCells / NUM_THREADS;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    uint end = (i == NUM_THREADS - 1) ? numCells : delta * (i + 1);
+    threads[i] = std::thread(countOrientations, cells, delta * i, end, &counts[i * numOrientations]);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    threads[i].join();
+  }
+  // Turn the counts into where each thread starts writing each orientation
+  uint position = 0;
+  for (uint j = 0; j < numOrientations; j++) {
+    cells->orientationOffsets[j] = position;
+    for (int i = 0; i < NUM_THREADS; i++) {
+      uint count = counts[i * numOrientations + j];
+      counts[i * numOrientations + j] = position;
+      position += count;
+    }
+    cells->orientations[j].cellCount = position - cells->orientationOffsets[j];
+  }
+  cells->orientationOffsets[numOrientations] = position;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    uint end = (i == NUM_THREADS - 1) ? numCells : delta * (i + 1);
+    threads[i] = std::thread(scatterOrientations, cells, delta * i, end, &counts[i * numOrientations]);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    threads[i].join();
+  }
+  delete[] counts;
+}
+
+void fillStateArray(Cells cells, double* stateArray) {
+  for (int i = 0; i < cells.height * cells.width; i++) {
+    stateArray[i] = cellModel.contributions[(cells.cells[i].type << 4) | cells.cells[i].state];
+  }
+}
+
 void saveCellsToFile(Cells cells, const char* fileName) {
   unsigned char* data = serializeCells(cells);
   std::ofstream outputStream;
@@ -135,164 +243,453 @@ void saveCellsToFile(Cells cells, const char* fileName) {
   delete[] data;
 }
 
-Cells readCellsFromFile(const char* fileName) {
-  std::ifstream inputStream;
-  inputStream.open(fileName);
+bool readCellsFromFile(const char* fileName, Cells* cells) {
+  std::ifstream inputStream(fileName, std::ios::binary);
+  if (!inputStream.is_open()) {
+    std::cout << "Could not open " << fileName << std::endl;
+    return false;
+  }
   inputStream.seekg(0, std::ios::end);
-  size_t length = inputStream.tellg();
+  std::streamoff length = inputStream.tellg();
+  inputStream.seekg(0, std::ios::beg);
+  // The width, height and number of orientations come first, and say how long the rest should be
+  uint header[3];
+  if (length < (std::streamoff) sizeof(header) || !inputStream.read((char*) header, sizeof(header))) {
+    std::cout << fileName << " is too short to be a dump of cells" << std::endl;
+    return false;
+  }
+  uint64_t expectedLength = sizeof(header) + (uint64_t) sizeof(Cell) * header[0] * header[1] + (sizeof(float) * 2 + sizeof(uint)) * (uint64_t) header[2];
+  if ((uint64_t) length < expectedLength || header[0] == 0 || header[1] == 0 || header[2] == 0) {
+    std::cout << fileName << " is truncated, or is not a dump of cells" << std::endl;
+    return false;
+  }
   inputStream.seekg(0, std::ios::beg);
   unsigned char* data = new unsigned char[length];
   inputStream.read((char*) data, length);
-  Cells output = readCells(data);
+  *cells = readCells(data);
   // Free the memory space
   delete[] data;
-  return output;
-}
-
-void updateCellsArea(Cells* currentState, double* distanceArray, double* stateArray, int start, int end) {
-  int pacemaker = 0;
-  int tissue = 1;
-  int restingTissue = 2;
-  __m256i pacemakerAVX = _mm256_set1_epi32(pacemaker);
-  __m256i tissueAVX = _mm256_set1_epi32(tissue);
-  __m256i restingTissueAVX = _mm256_set1_epi32(restingTissue);
-  __m256d firstHalfNeighbours;
-  __m256d secondHalfNeighbours;
-  __m128 firstHalfNeighboursSingle;
-  __m128 secondHalfNeighboursSingle;
-  __m256 neighbours;
-  __m256i neighboursRounded;
-  __m256i cellStates;
-  __m256i cellTypes;
-  __m256i stateArrayAVX;
-  __m256i isPacemaker;
-  __m256i isTissue;
-  __m256i isResting;
-  __m256i wasActive;
-  __m256i isZeroState;
-  __m256i isAboveThreshold;
-  __m256i negativeBitAVX = _mm256_set1_epi32(1 << 31);
-  __m256 floatNegativeBitAVX = *((__m256*) &negativeBitAVX);
-  __m256i zeroAVX = _mm256_set1_epi32(0);
-  __m256i oneAVX = _mm256_set1_epi32(1);
-  __m256i allOneBitsAVX = _mm256_sub_epi32(zeroAVX, oneAVX);
-  __m256i restingDurationAVX = _mm256_set1_epi32(REST_DURATION);
-  __m256i maxStateAVX = _mm256_set1_epi32(AP_DURATION);
-  __m256 thresholdAVX = _mm256_set1_ps(AP_THRESHOLD);
-  __m256i restingToNormal = _mm256_sub_epi32(tissueAVX, restingTissueAVX);
-  __m256i normalToResting = _mm256_sub_epi32(restingTissueAVX, tissueAVX);
-  __m256i cellOrientationIndexFirstHalf;
-  __m256i cellOrientationIndexSecondHalf;
-  __m256i cellIDsFirstHalf;
-  __m256i cellIDsSecondHalf;
-  __m256i stateIndexFirstHalf;
-  __m256i stateIndexSecondHalf;
-  __m256i numOrientations = _mm256_set1_epi32(currentState->numOrientations);
-  int cellStatesUpdated[8];
-  int cellTypesUpdatedInt[8];
-  int stateArrayUpdated[8];
-  CellType* cellTypesUpdated = (CellType*) cellTypesUpdatedInt;
-  for (int i = start; i < end; i+=8) {
-    cellIDsFirstHalf = _mm256_set_epi32(0, i + 3, 0, i + 2, 0, i + 1, 0, i);
-    cellIDsSecondHalf = _mm256_set_epi32(0, i + 7, 0, i + 6, 0, i + 5, 0, i + 4);
-    cellOrientationIndexFirstHalf = _mm256_set_epi64x(currentState->cells[(i + 3)].orientationIndex, currentState->cells[(i + 2)].orientationIndex, currentState->cells[(i + 1)].orientationIndex, currentState->cells[i].orientationIndex);
-    cellOrientationIndexSecondHalf = _mm256_set_epi64x(currentState->cells[(i + 7)].orientationIndex, currentState->cells[(i + 6)].orientationIndex, currentState->cells[(i + 5)].orientationIndex, currentState->cells[(i + 4)].orientationIndex);
-    // Convert neighbourhood counts to single-precision, so 8 of them can be stored at once
-    stateIndexFirstHalf = _mm256_add_epi64(_mm256_mul_epu32(cellIDsFirstHalf, numOrientations), cellOrientationIndexFirstHalf);
-    stateIndexSecondHalf = _mm256_add_epi64(_mm256_mul_epu32(cellIDsSecondHalf, numOrientations), cellOrientationIndexSecondHalf);
-    firstHalfNeighbours = _mm256_i64gather_pd(distanceArray, stateIndexFirstHalf, 8);
-    secondHalfNeighbours = _mm256_i64gather_pd(distanceArray, stateIndexSecondHalf, 8);
-    firstHalfNeighboursSingle = _mm256_cvtpd_ps(firstHalfNeighbours);
-    secondHalfNeighboursSingle = _mm256_cvtpd_ps(secondHalfNeighbours);
-    neighbours = _mm256_castps128_ps256(firstHalfNeighboursSingle);
-    neighbours = _mm256_insertf128_ps(neighbours, secondHalfNeighboursSingle, 1);
-    neighbours = _mm256_sub_ps(neighbours, thresholdAVX);
-    neighbours = _mm256_and_ps(neighbours, floatNegativeBitAVX);
-    // We now have 0 if the count is above the threshold, and 1 otherwise, but this 
-    // is on the first bit
-    neighboursRounded = *((__m256i*) &neighbours);
-    // Shift 31 bits to the right
-    neighboursRounded = _mm256_srli_epi32(neighboursRounded, 31);
-    neighboursRounded = _mm256_sub_epi32(neighboursRounded, oneAVX);
-
-    // Store the next eight cell states
-    cellStates = _mm256_set_epi32(currentState->cells[(i + 7)].state, currentState->cells[(i + 6)].state, currentState->cells[(i + 5)].state, currentState->cells[(i + 4)].state, currentState->cells[(i + 3)].state, currentState->cells[(i + 2)].state, currentState->cells[(i + 1)].state, currentState->cells[i].state);
-    // And the cell types
-    cellTypes = _mm256_set_epi32(currentState->cells[(i + 7)].type, currentState->cells[(i + 6)].type, currentState->cells[(i + 5)].type, currentState->cells[(i + 4)].type, currentState->cells[(i + 3)].type, currentState->cells[(i + 2)].type, currentState->cells[(i + 1)].type, currentState->cells[i].type);
-    // This value is 0 if the cell is a pacemaker, and some other value otherwise
-    isPacemaker = _mm256_xor_si256(pacemakerAVX, cellTypes);
-    // Clamp value to 0 or 1
-    isPacemaker = _mm256_min_epu32(isPacemaker, oneAVX);
-    // Subtract one so that if the cell is a pacemaker, the bits are all one, and otherwise the bits are all zero
-    isPacemaker = _mm256_sub_epi32(isPacemaker, oneAVX);
-    isTissue = _mm256_xor_si256(tissueAVX, cellTypes);
-    isTissue = _mm256_min_epu32(isTissue, oneAVX);
-    isTissue = _mm256_sub_epi32(isTissue, oneAVX);
-    isResting = _mm256_xor_si256(restingTissueAVX, cellTypes);
-    isResting = _mm256_min_epu32(isResting, oneAVX);
-    isResting = _mm256_sub_epi32(isResting, oneAVX);
-
-    wasActive = _mm256_xor_si256(cellStates, zeroAVX);
-    wasActive = _mm256_min_epu32(wasActive, oneAVX);
-    wasActive = _mm256_sub_epi32(wasActive, oneAVX);
-    wasActive = _mm256_xor_si256(wasActive, allOneBitsAVX);
-
-    // If the cell state is not initially 0, then reduce it by one
-    cellStates = _mm256_sub_epi32(cellStates, _mm256_and_si256(wasActive, oneAVX));
-    isZeroState = _mm256_xor_si256(cellStates, zeroAVX);
-    isZeroState = _mm256_min_epu32(isZeroState, oneAVX);
-    isZeroState = _mm256_sub_epi32(isZeroState, oneAVX);
-    // If the cell state is 0, and the cell is a pacemaker then set the cell state to AP_DURATION
-    cellStates = _mm256_add_epi32(cellStates, _mm256_and_si256(maxStateAVX, _mm256_and_si256(isZeroState, isPacemaker)));
-    // If the cell state is 0 and the cell is resting, then the cell is now set to normal tissue
-    cellTypes = _mm256_add_epi32(cellTypes, _mm256_and_si256(restingToNormal, _mm256_and_si256(isZeroState, isResting)));
-    // If the cell state is 0 and the cell was active, then the cell is now resting tissue with a state of REST_DURATION
-    cellStates = _mm256_add_epi32(cellStates, _mm256_and_si256(restingDurationAVX, _mm256_and_si256(isZeroState, _mm256_and_si256(wasActive, isTissue))));
-    cellTypes = _mm256_add_epi32(cellTypes, _mm256_and_si256(normalToResting, _mm256_and_si256(isZeroState, _mm256_and_si256(wasActive, isTissue))));
-    isTissue = _mm256_xor_si256(tissueAVX, cellTypes);
-    isTissue = _mm256_min_epu32(isTissue, oneAVX);
-    isTissue = _mm256_sub_epi32(isTissue, oneAVX);
-    // Alternatively, then if the cell is normal tissue and not already active, then set the cell's state to AP_DURATION only if the neighbor count is greater than AP_THRESHOLD
-    cellStates = _mm256_add_epi32(cellStates, _mm256_and_si256(maxStateAVX, _mm256_and_si256(neighboursRounded, _mm256_and_si256(isZeroState, isTissue))));
-
-    // Only count the cells as part of the state array if they are a pacemaker or normal tissue cell
-    stateArrayAVX = _mm256_and_si256(cellStates, _mm256_or_si256(isPacemaker, isTissue));
-    _mm256_storeu_si256((__m256i*) cellStatesUpdated, cellStates);
-    _mm256_storeu_si256((__m256i*) cellTypesUpdatedInt, cellTypes);
-    _mm256_storeu_si256((__m256i*) stateArrayUpdated, stateArrayAVX);
-
-    for (int j = 0; j < 8; j++) {
-      currentState->cells[(i + j)].state = cellStatesUpdated[j];
-      currentState->cells[(i + j)].type = cellTypesUpdated[j];
-      stateArray[i + j] = (double) stateArrayUpdated[j];
+  // The kernels index their tables by (type << 4) | state and the neighbour counts by orientation, so anything out
+  // of range would be read past the end of them
+  for (uint i = 0; i < cells->width * cells->height; i++) {
+    Cell cell = cells->cells[i];
+    if (cell.type >= cellModel.numTypes || cell.state >= MAX_CELL_STATES || cell.orientationIndex >= cells->numOrientations) {
+      std::cout << fileName << " has a cell (at " << i % cells->width << ", " << i / cells->width << ") with type " << cell.type << ", state " << cell.state
+        << " and orientation " << cell.orientationIndex << ", which the cell model or the dump does not have" << std::endl;
+      freeCells(*cells);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reference implementation of the cell update - the SIMD kernels must produce exactly the same cell states.
+// The rules themselves all come from cellModel's lookup tables
+bool updateCellsAreaScalar(Cells* currentState, double* distanceArray, double* stateArray, int start, int end) {
+  bool isQuiescent = true;
+  for (int i = start; i < end; i++) {
+    Cell* cell = &currentState->cells[i];
+    // The SIMD kernels compare the neighbour count in single-precision, so the same must be done here
+    float neighbours = (float) distanceArray[(long) i * currentState->numOrientations + cell->orientationIndex];
+    bool isAboveThreshold = !std::signbit(neighbours - cellModel.thresholds[cell->type]);
+    uint8_t next = cellModel.transitions[isAboveThreshold][(cell->type << 4) | cell->state];
+    cell->type = (CellType) (next >> 4);
+    cell->state = next & 0xF;
+    stateArray[i] = (double) cellModel.contributions[next];
+    isQuiescent = isQuiescent && cellModel.quiescent[next];
+  }
+  return isQuiescent;
+}
+
+// Looks up each byte of indices in one of cellModel's 128 entry tables. Each vpshufb looks up 16 entries
+// (i.e. one cell type), and the results are blended together by the type in the top nibble of each index
+__attribute__((target("avx2")))
+static inline __m256i lookupAVX2(const uint8_t* table, __m256i indices) {
+  __m256i tableChunks = _mm256_and_si256(_mm256_srli_epi16(indices, 4), _mm256_set1_epi8(0xF));
+  __m256i result = _mm256_setzero_si256();
+  for (int i = 0; i < MAX_CELL_TYPES; i++) {
+    __m256i entries = _mm256_broadcastsi128_si256(_mm_load_si128((__m128i*) &table[i * MAX_CELL_STATES]));
+    __m256i isInChunk = _mm256_cmpeq_epi8(tableChunks, _mm256_set1_epi8(i));
+    result = _mm256_blendv_epi8(result, _mm256_shuffle_epi8(entries, indices), isInChunk);
+  }
+  return result;
+}
+
+// Packs the low bytes of 4 vectors of 8 ints into one vector of 32 bytes, in order
+__attribute__((target("avx2")))
+static inline __m256i packBytesAVX2(__m256i a, __m256i b, __m256i c, __m256i d) {
+  __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+  // The packs work within each 128-bit lane, so the groups of 4 are left interleaved
+  return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+// Updates 32 cells at a time, with every cell's type and state packed into a byte for the lookups
+__attribute__((target("avx2")))
+bool updateCellsAreaAVX2(Cells* currentState, double* distanceArray, double* stateArray, int start, int end) {
+  static_assert(sizeof(Cell) == 3 * sizeof(int), "The SIMD kernels gather cells as three 32-bit fields");
+  __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i threeAVX = _mm256_set1_epi32(3);
+  __m256i numOrientations = _mm256_set1_epi64x(currentState->numOrientations);
+  __m256 thresholds = _mm256_loadu_ps(cellModel.thresholds);
+  int* cellFields = (int*) currentState->cells;
+  __m256i packedCells[4];
+  __m256i isAboveThreshold[4];
+  alignas(32) uint8_t nextCells[32];
+  alignas(32) uint8_t contributions[32];
+  __m256i isQuiescent = _mm256_set1_epi8(1);
+  int i;
+  for (i = start; i + 32 <= end; i += 32) {
+    for (int j = 0; j < 4; j++) {
+      __m256i cellIDs = _mm256_add_epi32(_mm256_set1_epi32(i + j * 8), laneOffsets);
+      // Offsets (in ints) of each cell's type, with the state and orientation index following it
+      __m256i fieldIndex = _mm256_mullo_epi32(cellIDs, threeAVX);
+      __m256i cellTypes = _mm256_i32gather_epi32(cellFields, fieldIndex, 4);
+      __m256i cellStates = _mm256_i32gather_epi32(cellFields, _mm256_add_epi32(fieldIndex, _mm256_set1_epi32(1)), 4);
+      __m256i cellOrientations = _mm256_i32gather_epi32(cellFields, _mm256_add_epi32(fieldIndex, _mm256_set1_epi32(2)), 4);
+      // The neighbour count indices are worked out in 64 bits, as cells * orientations can overflow 32 bits
+      __m256i firstStateIndex = _mm256_add_epi64(_mm256_mul_epu32(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(cellIDs)), numOrientations),
+        _mm256_cvtepu32_epi64(_mm256_castsi256_si128(cellOrientations)));
+      __m256i secondStateIndex = _mm256_add_epi64(_mm256_mul_epu32(_mm256_cvtepu32_epi64(_mm256_extracti128_si256(cellIDs, 1)), numOrientations),
+        _mm256_cvtepu32_epi64(_mm256_extracti128_si256(cellOrientations, 1)));
+      // Convert neighbourhood counts to single-precision, so 8 of them can be stored at once
+      __m128 firstHalfNeighbours = _mm256_cvtpd_ps(_mm256_i64gather_pd(distanceArray, firstStateIndex, 8));
+      __m128 secondHalfNeighbours = _mm256_cvtpd_ps(_mm256_i64gather_pd(distanceArray, secondStateIndex, 8));
+      __m256 neighbours = _mm256_insertf128_ps(_mm256_castps128_ps256(firstHalfNeighbours), secondHalfNeighbours, 1);
+      neighbours = _mm256_sub_ps(neighbours, _mm256_permutevar8x32_ps(thresholds, cellTypes));
+      // All ones when the sign bit of (count - threshold) is clear, i.e. the cell is above threshold
+      isAboveThreshold[j] = _mm256_xor_si256(_mm256_srai_epi32(_mm256_castps_si256(neighbours), 31), _mm256_set1_epi32(-1));
+      packedCells[j] = _mm256_or_si256(_mm256_slli_epi32(cellTypes, 4), cellStates);
+    }
+    __m256i packed = packBytesAVX2(packedCells[0], packedCells[1], packedCells[2], packedCells[3]);
+    __m256i aboveMask = packBytesAVX2(isAboveThreshold[0], isAboveThreshold[1], isAboveThreshold[2], isAboveThreshold[3]);
+    __m256i next = _mm256_blendv_epi8(lookupAVX2(cellModel.transitions[0], packed), lookupAVX2(cellModel.transitions[1], packed), aboveMask);
+    _mm256_store_si256((__m256i*) nextCells, next);
+    _mm256_store_si256((__m256i*) contributions, lookupAVX2(cellModel.contributions, next));
+    isQuiescent = _mm256_and_si256(isQuiescent, lookupAVX2(cellModel.quiescent, next));
+    for (int j = 0; j < 32; j++) {
+      currentState->cells[(i + j)].type = (CellType) (nextCells[j] >> 4);
+      currentState->cells[(i + j)].state = nextCells[j] & 0xF;
+      stateArray[i + j] = (double) contributions[j];
     }
   }
+  // Any leftover cells (when the area is not a multiple of 32) are handled by the reference kernel
+  bool isTailQuiescent = updateCellsAreaScalar(currentState, distanceArray, stateArray, i, end);
+  return isTailQuiescent && _mm256_movemask_epi8(_mm256_cmpeq_epi8(isQuiescent, _mm256_setzero_si256())) == 0;
 }
 
-void advanceCells(Cells* currentState, NeighbourCounter* neighbourCounter) {
+// Same as lookupAVX2, but the results are merged with mask registers rather than blends
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i lookupAVX512(const uint8_t* table, __m512i indices) {
+  __m512i tableChunks = _mm512_and_si512(_mm512_srli_epi16(indices, 4), _mm512_set1_epi8(0xF));
+  __m512i result = _mm512_setzero_si512();
+  for (int i = 0; i < MAX_CELL_TYPES; i++) {
+    __m512i entries = _mm512_broadcast_i32x4(_mm_load_si128((__m128i*) &table[i * MAX_CELL_STATES]));
+    result = _mm512_mask_shuffle_epi8(result, _mm512_cmpeq_epi8_mask(tableChunks, _mm512_set1_epi8(i)), entries, indices);
+  }
+  return result;
+}
+
+// Same as updateCellsAreaAVX2, but 64 cells at a time
+__attribute__((target("avx512f,avx512bw,avx512dq")))
+bool updateCellsAreaAVX512(Cells* currentState, double* distanceArray, double* stateArray, int start, int end) {
+  __m512i laneOffsets = _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  __m512i oneAVX = _mm512_set1_epi32(1);
+  __m512i threeAVX = _mm512_set1_epi32(3);
+  __m512i negativeBitAVX = _mm512_set1_epi32(1 << 31);
+  __m512i numOrientations = _mm512_set1_epi64(currentState->numOrientations);
+  __m512 thresholds = _mm512_castps256_ps512(_mm256_loadu_ps(cellModel.thresholds));
+  int* cellFields = (int*) currentState->cells;
+  __m512i fieldIndex[4];
+  bool isQuiescent = true;
+  int i;
+  for (i = start; i + 64 <= end; i += 64) {
+    __m512i packed = _mm512_setzero_si512();
+    __mmask64 isAboveThreshold = 0;
+    for (int j = 0; j < 4; j++) {
+      __m512i cellIDs = _mm512_add_epi32(_mm512_set1_epi32(i + j * 16), laneOffsets);
+      fieldIndex[j] = _mm512_mullo_epi32(cellIDs, threeAVX);
+      __m512i cellTypes = _mm512_i32gather_epi32(fieldIndex[j], cellFields, 4);
+      __m512i cellStates = _mm512_i32gather_epi32(_mm512_add_epi32(fieldIndex[j], oneAVX), cellFields, 4);
+      __m512i cellOrientations = _mm512_i32gather_epi32(_mm512_add_epi32(fieldIndex[j], _mm512_set1_epi32(2)), cellFields, 4);
+      // In 64 bits, as in the AVX2 kernel
+      __m512i firstStateIndex = _mm512_add_epi64(_mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm512_castsi512_si256(cellIDs)), numOrientations),
+        _mm512_cvtepu32_epi64(_mm512_castsi512_si256(cellOrientations)));
+      __m512i secondStateIndex = _mm512_add_epi64(_mm512_mul_epu32(_mm512_cvtepu32_epi64(_mm512_extracti32x8_epi32(cellIDs, 1)), numOrientations),
+        _mm512_cvtepu32_epi64(_mm512_extracti32x8_epi32(cellOrientations, 1)));
+      __m256 firstHalfNeighbours = _mm512_cvtpd_ps(_mm512_i64gather_pd(firstStateIndex, distanceArray, 8));
+      __m256 secondHalfNeighbours = _mm512_cvtpd_ps(_mm512_i64gather_pd(secondStateIndex, distanceArray, 8));
+      __m512 neighbours = _mm512_insertf32x8(_mm512_castps256_ps512(firstHalfNeighbours), secondHalfNeighbours, 1);
+      neighbours = _mm512_sub_ps(neighbours, _mm512_permutexvar_ps(cellTypes, thresholds));
+      // Above the threshold exactly when the sign bit of (count - threshold) is clear, as in the AVX2 kernel
+      isAboveThreshold |= (__mmask64) _mm512_testn_epi32_mask(_mm512_castps_si512(neighbours), negativeBitAVX) << (j * 16);
+      __m128i packedBytes = _mm512_cvtepi32_epi8(_mm512_or_si512(_mm512_slli_epi32(cellTypes, 4), cellStates));
+      packed = _mm512_inserti32x4(packed, packedBytes, j);
+    }
+    __m512i next = _mm512_mask_blend_epi8(isAboveThreshold, lookupAVX512(cellModel.transitions[0], packed), lookupAVX512(cellModel.transitions[1], packed));
+    __m512i contributions = lookupAVX512(cellModel.contributions, next);
+    __m512i quiescent = lookupAVX512(cellModel.quiescent, next);
+    isQuiescent = isQuiescent && _mm512_test_epi8_mask(quiescent, quiescent) == ~(__mmask64) 0;
+    for (int j = 0; j < 4; j++) {
+      __m512i nextCells = _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(next, j));
+      __m512i cellContributions = _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(contributions, j));
+      _mm512_i32scatter_epi32(cellFields, fieldIndex[j], _mm512_srli_epi32(nextCells, 4), 4);
+      _mm512_i32scatter_epi32(cellFields, _mm512_add_epi32(fieldIndex[j], oneAVX), _mm512_and_si512(nextCells, _mm512_set1_epi32(0xF)), 4);
+      _mm512_storeu_pd(&stateArray[i + j * 16], _mm512_cvtepi32_pd(_mm512_castsi512_si256(cellContributions)));
+      _mm512_storeu_pd(&stateArray[i + j * 16 + 8], _mm512_cvtepi32_pd(_mm512_extracti32x8_epi32(cellContributions, 1)));
+    }
+  }
+  bool isTailQuiescent = updateCellsAreaScalar(currentState, distanceArray, stateArray, i, end);
+  return isQuiescent && isTailQuiescent;
+}
+
+// Reference implementation of the spectrum multiplication
+void multiplyComplexScalar(fftw_complex* array1, fftw_complex* array2, int length, double normalizationFactor) {
+  for (int i = 0; i < length; i++) {
+    double real = array1[i][0] * array2[i][0] - array1[i][1] * array2[i][1];
+    double imag = array1[i][0] * array2[i][1] + array1[i][1] * array2[i][0];
+    array1[i][0] = real / normalizationFactor;
+    array1[i][1] = imag / normalizationFactor;
+  }
+}
+
+__attribute__((target("avx2")))
+void multiplyComplexAVX2(fftw_complex* array1, fftw_complex* array2, int length, double normalizationFactor) {
+  __m256d normalizationFactorAVX = _mm256_set1_pd(normalizationFactor);
+  __m256d array1Real;
+  __m256d array1Imag;
+  __m256d array2Real;
+  __m256d array2Imag;
+  __m256d realResult;
+  __m256d imagResult;
+  double real[4];
+  double imag[4];
+  int i;
+  for (i = 0; i + 4 <= length; i += 4) {
+    array1Real = _mm256_set_pd(array1[i + 3][0], array1[i + 2][0], array1[i + 1][0], array1[i][0]);
+    array1Imag = _mm256_set_pd(array1[i + 3][1], array1[i + 2][1], array1[i + 1][1], array1[i][1]);
+    array2Real = _mm256_set_pd(array2[i + 3][0], array2[i + 2][0], array2[i + 1][0], array2[i][0]);
+    array2Imag = _mm256_set_pd(array2[i + 3][1], array2[i + 2][1], array2[i + 1][1], array2[i][1]);
+    realResult = _mm256_sub_pd(_mm256_mul_pd(array1Real, array2Real), _mm256_mul_pd(array1Imag, array2Imag));
+    imagResult = _mm256_add_pd(_mm256_mul_pd(array1Real, array2Imag), _mm256_mul_pd(array1Imag, array2Real));
+    realResult = _mm256_div_pd(realResult, normalizationFactorAVX);
+    imagResult = _mm256_div_pd(imagResult, normalizationFactorAVX);
+    _mm256_storeu_pd(real, realResult);
+    _mm256_storeu_pd(imag, imagResult);
+    for (int j = 0; j < 4; j++) {
+      array1[i + j][0] = real[j];
+      array1[i + j][1] = imag[j];
+    }
+  }
+  multiplyComplexScalar(&array1[i], &array2[i], length - i, normalizationFactor);
+}
+
+// Works directly on the interleaved (real, imag) pairs, 4 complex numbers at a time
+__attribute__((target("avx512f,avx512dq")))
+void multiplyComplexAVX512(fftw_complex* array1, fftw_complex* array2, int length, double normalizationFactor) {
+  __m512d normalizationFactorAVX = _mm512_set1_pd(normalizationFactor);
+  int i;
+  for (i = 0; i + 4 <= length; i += 4) {
+    __m512d a = _mm512_loadu_pd(&array1[i][0]);
+    __m512d b = _mm512_loadu_pd(&array2[i][0]);
+    // (a.real, a.real), (a.imag, a.imag) and (b.imag, b.real) for each complex number
+    __m512d aReal = _mm512_movedup_pd(a);
+    __m512d aImag = _mm512_permute_pd(a, 0xFF);
+    __m512d bSwapped = _mm512_permute_pd(b, 0x55);
+    __m512d realProducts = _mm512_mul_pd(aReal, b);
+    __m512d imagProducts = _mm512_mul_pd(aImag, bSwapped);
+    // Subtract for the real parts (even lanes) and add for the imaginary parts (odd lanes)
+    __m512d result = _mm512_mask_add_pd(_mm512_sub_pd(realProducts, imagProducts), 0xAA, realProducts, imagProducts);
+    _mm512_storeu_pd(&array1[i][0], _mm512_div_pd(result, normalizationFactorAVX));
+  }
+  multiplyComplexScalar(&array1[i], &array2[i], length - i, normalizationFactor);
+}
+
+bool (*updateCellsArea)(Cells* currentState, double* distanceArray, double* stateArray, int start, int end) = updateCellsAreaScalar;
+void (*multiplyComplex)(fftw_complex* array1, fftw_complex* array2, int length, double normalizationFactor) = multiplyComplexScalar;
+
+SimdLevel detectSimdLevel() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")) {
+    return SimdLevel::AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  return SimdLevel::Scalar;
+}
+
+const char* simdLevelToString(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::Scalar:
+      return "scalar";
+    case SimdLevel::AVX2:
+      return "avx2";
+    case SimdLevel::AVX512:
+      return "avx512";
+    default:
+      return NULL;
+  }
+}
+
+bool parseSimdLevel(const char* name, SimdLevel* level) {
+  for (int i = SimdLevel::Scalar; i <= SimdLevel::AVX512; i++) {
+    if (strcmp(name, simdLevelToString((SimdLevel) i)) == 0) {
+      *level = (SimdLevel) i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void setSimdLevel(SimdLevel level) {
+  switch (level) {
+    case SimdLevel::AVX512:
+      updateCellsArea = updateCellsAreaAVX512;
+      multiplyComplex = multiplyComplexAVX512;
+      break;
+    case SimdLevel::AVX2:
+      updateCellsArea = updateCellsAreaAVX2;
+      multiplyComplex = multiplyComplexAVX2;
+      break;
+    default:
+      updateCellsArea = updateCellsAreaScalar;
+      multiplyComplex = multiplyComplexScalar;
+      break;
+  }
+}
+
+// Updates a worker's share of the tiles in its band, and records which of them are still active, how many
+// active cells they have, and their hashes
+void updateTiles(Cells* currentState, NeighbourCounter* neighbourCounter, TileActivity* tiles, uint* tilesToUpdate, int numTiles, uint worker, uint64_t* activeCells) {
+  pinWorker(worker);
+  // tilesToUpdate is in row-major order, so each band's tiles are contiguous in it
+  uint band = threadPlacement.workerBands[worker];
+  uint* bandStart = std::lower_bound(tilesToUpdate, tilesToUpdate + numTiles, bandStartTileRow(band, tiles->tilesY) * tiles->tilesX);
+  uint* bandEnd = std::lower_bound(tilesToUpdate, tilesToUpdate + numTiles, bandStartTileRow(band + 1, tiles->tilesY) * tiles->tilesX);
+  // The band's tiles are interleaved between its workers, so that the work is balanced even when activity is clustered
+  int firstTile = bandStart - tilesToUpdate;
+  int numBandWorkers = 0;
+  for (uint i = 0; i < NUM_THREADS; i++) {
+    if (threadPlacement.workerBands[i] == band) {
+      if (i < worker) {
+        firstTile++;
+      }
+      numBandWorkers++;
+    }
+  }
+  for (int k = firstTile; k < bandEnd - tilesToUpdate; k += numBandWorkers) {
+    int tileI = tilesToUpdate[k] / tiles->tilesX;
+    int tileJ = tilesToUpdate[k] % tiles->tilesX;
+    int lastRow = std::min((tileI + 1) * TILE_SIZE, (int) currentState->height);
+    int firstColumn = tileJ * TILE_SIZE;
+    int lastColumn = std::min(firstColumn + TILE_SIZE, (int) currentState->width);
+    bool isQuiescent = true;
+    uint64_t tileHash = 0;
+    for (int i = tileI * TILE_SIZE; i < lastRow; i++) {
+      int rowStart = i * currentState->width;
+      isQuiescent &= updateCellsArea(currentState, neighbourCounter->neighbourArray, neighbourCounter->stateArray, rowStart + firstColumn, rowStart + lastColumn);
+      // While the row is still in cache
+      for (int j = rowStart + firstColumn; j < rowStart + lastColumn; j++) {
+        Cell cell = currentState->cells[j];
+        // Active cells are those counting towards their neighbours, whichever model is loaded
+        *activeCells += cellModel.contributions[(cell.type << 4) | cell.state] > 0;
+        tileHash += hashCell(j, cell);
+      }
+    }
+    // Only tiles which are updated can change, so the others' hashes are still correct
+    tiles->hashes[tilesToUpdate[k]] = tileHash;
+    tiles->active[tilesToUpdate[k]] = !isQuiescent;
+    tiles->dirty[tilesToUpdate[k]] = 1;
+  }
+}
+
+void advanceCells(Cells* currentState, NeighbourCounter* neighbourCounter, TileActivity* tiles) {
   auto start = std::chrono::high_resolution_clock::now();
+  auto stepStart = std::chrono::steady_clock::now();
   neighbourCounter->calculateNeighbourCounts();
+  auto stageStart = recordStage(TelemetryStage::FFTStage, stepStart);
+  // Tiles which are quiescent, and too far from any activity to be affected by it, would not change, so are skipped
+  uint* tilesToUpdate = new uint[tiles->tilesX * tiles->tilesY];
+  int numTiles = tiles->findTilesToUpdate(tilesToUpdate);
   // Safe to thread here as mutex is locked when this function is called
-  constexpr int NUM_THREADS = 8;
   std::thread threads[NUM_THREADS];
-  int delta = (currentState->width * currentState->height) / NUM_THREADS;
-  for (int i = 0; i < NUM_THREADS; i++) {
-    threads[i] = std::thread(updateCellsArea, currentState, neighbourCounter->neighbourArray, neighbourCounter->stateArray, delta * i, delta * (i + 1));
+  uint64_t activeCells[NUM_THREADS] = {0};
+  for (uint i = 0; i < NUM_THREADS; i++) {
+    threads[i] = std::thread(updateTiles, currentState, neighbourCounter, tiles, tilesToUpdate, numTiles, i, &activeCells[i]);
   }
+  uint64_t totalActiveCells = 0;
   for (int i = 0; i < NUM_THREADS; i++) {
     threads[i].join();
+    totalActiveCells += activeCells[i];
   }
+  delete[] tilesToUpdate;
+  recordStage(TelemetryStage::UpdateStage, stageStart);
+  recordStage(TelemetryStage::StepStage, stepStart);
+  telemetry.activeCells.store(totalActiveCells, std::memory_order_relaxed);
+  telemetry.stepsTaken.fetch_add(1, std::memory_order_relaxed);
   auto end = std::chrono::high_resolution_clock::now();
   auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-  std::cout << "Time taken to calculate cells: " << elapsed.count() << "ms" << std::endl;
+  std::cout << "Time taken to calculate cells: " << elapsed.count() << "ms (" << numTiles << "/" << tiles->tilesX * tiles->tilesY << " tiles updated)" << std::endl;
+}
+
+RenderCache createRenderCache(SDL_Renderer* render, Cells cells) {
+  RenderCache cache;
+  cache.width = cells.width;
+  cache.height = cells.height;
+  cache.texture = SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, cells.width, cells.height);
+  cache.pixels = new uint32_t[cells.width * cells.height];
+  return cache;
 }
 
-void renderCells(Cells cells, SDL_Renderer* render, TTF_Font* font, float xOffset, float yOffset, float zoomFactor, int selectedCellI, int selectedCellJ,
-    int firstCornerX, int secondCornerX, int firstCornerY, int secondCornerY) {
+void freeRenderCache(RenderCache* cache) {
+  SDL_DestroyTexture(cache->texture);
+  delete[] cache->pixels;
+}
+
+// Recalculates the pixels of a tile and uploads them to the texture
+uint32_t cellColour(uint8_t packed) {
+  if (cellModel.contributions[packed] == 0) {
+    return 0xFF000000;
+  }
+  // Whether the type's state 0 moves on to another of its states without any active neighbours
+  uint8_t resting = packed & 0xF0;
+  uint8_t next = cellModel.transitions[0][resting];
+  bool firesOnItsOwn = next != resting && (next & 0xF0) == resting;
+  return firesOnItsOwn ? 0xFFFF00FF : 0xFFFF0000;
+}
+
+void drawTile(Cells cells, RenderCache* cache, int tileI, int tileJ) {
+  int firstRow = tileI * TILE_SIZE;
+  int firstColumn = tileJ * TILE_SIZE;
+  int lastRow = std::min(firstRow + TILE_SIZE, (int) cells.height);
+  int lastColumn = std::min(firstColumn + TILE_SIZE, (int) cells.width);
+  for (int i = firstRow; i < lastRow; i++) {
+    for (int j = firstColumn; j < lastColumn; j++) {
+      Cell currentCell = cells.cells[i * cells.width + j];
+      // Only the cells which count towards their neighbours (i.e. are active) are drawn
+      cache->pixels[i * cells.width + j] = cellColour((currentCell.type << 4) | currentCell.state);
+    }
+  }
+  SDL_Rect tileRect = {firstColumn, firstRow, lastColumn - firstColumn, lastRow - firstRow};
+  SDL_UpdateTexture(cache->texture, &tileRect, &cache->pixels[firstRow * cells.width + firstColumn], cells.width * sizeof(uint32_t));
+}
+
+void renderCells(Cells cells, RenderCache* cache, TileActivity* tiles, SDL_Renderer* render, TTF_Font* font, float xOffset, float yOffset, float zoomFactor,
+    int selectedCellI, int selectedCellJ, int firstCornerX, int secondCornerX, int firstCornerY, int secondCornerY) {
   auto start = std::chrono::high_resolution_clock::now();
+  // Only the tiles which may have changed since the last frame need drawing again
+  int tilesDrawn = 0;
+  for (int i = 0; i < tiles->tilesY; i++) {
+    for (int j = 0; j < tiles->tilesX; j++) {
+      if (tiles->dirty[i * tiles->tilesX + j]) {
+        drawTile(cells, cache, i, j);
+        tiles->dirty[i * tiles->tilesX + j] = 0;
+        tilesDrawn++;
+      }
+    }
+  }
   SDL_SetRenderDrawColor(render, 0, 0, 0, 0);
   SDL_RenderClear(render);
-  SDL_SetRenderDrawColor(render, 255, 0, 0, 255);
   if (firstCornerX > secondCornerX) {
     std::swap(firstCornerX, secondCornerX);
   }
@@ -303,35 +700,35 @@ void renderCells(Cells cells, SDL_Renderer* render, TTF_Font* font, float xOffse
   int firstCornerXScreenSpace = (firstCornerY + xOffset) * zoomFactor;
   int secondCornerYScreenSpace = (secondCornerX + yOffset) * zoomFactor;
   int secondCornerXScreenSpace = (secondCornerY + xOffset) * zoomFactor;
-  SDL_FRect cell;
-  bool hasSelectedCell = false;
-  Cell selectedCell;
-  for (int i = (int) -yOffset - 1; i < (int) (cells.height / zoomFactor - yOffset) + 1; i++) {
-    for (int j = (int) -xOffset - 1; j < (int) (cells.width / zoomFactor - xOffset) + 1; j++) {
-      SDL_SetRenderDrawColor(render, 255, 0, 0, 255);
-      Cell currentCell = cells.cells[(i % cells.height) * cells.width + (j % cells.width)];
-      if ((i % cells.height) == selectedCellI && (j % cells.width) == selectedCellJ) {
-        selectedCell = currentCell;
-        hasSelectedCell = true;
+  // A periodic grid is drawn as many times as is needed to fill the window, while an insulated one is only drawn once
+  int firstCopyI = 0;
+  int lastCopyI = 0;
+  int firstCopyJ = 0;
+  int lastCopyJ = 0;
+  if (cells.boundaryMode == BoundaryMode::Periodic) {
+    firstCopyI = std::floor(-yOffset / cells.height);
+    lastCopyI = std::floor((cells.height / zoomFactor - yOffset) / cells.height);
+    firstCopyJ = std::floor(-xOffset / cells.width);
+    lastCopyJ = std::floor((cells.width / zoomFactor - xOffset) / cells.width);
+  }
+  bool hasSelectedCell = selectedCellI >= 0 && selectedCellI < cells.height && selectedCellJ >= 0 && selectedCellJ < cells.width;
+  for (int copyI = firstCopyI; copyI <= lastCopyI; copyI++) {
+    for (int copyJ = firstCopyJ; copyJ <= lastCopyJ; copyJ++) {
+      SDL_FRect copyRect;
+      copyRect.x = (copyJ * (float) cells.width + xOffset) * zoomFactor;
+      copyRect.y = (copyI * (float) cells.height + yOffset) * zoomFactor;
+      copyRect.w = cells.width * zoomFactor;
+      copyRect.h = cells.height * zoomFactor;
+      SDL_RenderCopyF(render, cache->texture, NULL, &copyRect);
+      if (hasSelectedCell) {
+        SDL_FRect cell;
         SDL_SetRenderDrawColor(render, 100, 100, 100, 255);
-        cell.x = (j + xOffset) * zoomFactor;
-        cell.y = (i + yOffset) * zoomFactor;
+        cell.x = (copyJ * (float) cells.width + selectedCellJ + xOffset) * zoomFactor;
+        cell.y = (copyI * (float) cells.height + selectedCellI + yOffset) * zoomFactor;
         cell.w = zoomFactor;
         cell.h = zoomFactor;
         SDL_RenderFillRectF(render, &cell);
       }
-      else {
-        if (currentCell.state > 0 && currentCell.type != CellType::RestingTissue) {
-          if (currentCell.type == Pacemaker) {
-            SDL_SetRenderDrawColor(render, 255, 0, 255, 255);
-          }
-          cell.x = (j + xOffset) * zoomFactor;
-          cell.y = (i + yOffset) * zoomFactor;
-          cell.w = zoomFactor;
-          cell.h = zoomFactor;
-          SDL_RenderFillRectF(render, &cell);
-        }
-      }
     }
   }
   SDL_Rect selectedRect;
@@ -344,6 +741,7 @@ void renderCells(Cells cells, SDL_Renderer* render, TTF_Font* font, float xOffse
     SDL_RenderDrawRect(render, &selectedRect);
   }
   if (hasSelectedCell) {
+    Cell selectedCell = cells.cells[selectedCellI * cells.width + selectedCellJ];
     // TODO: automatic file location OR have a font folder in the project
     SDL_Color textColor = {255, 255, 255, 255};
     char* message = new char[100];
@@ -356,12 +754,13 @@ void renderCells(Cells cells, SDL_Renderer* render, TTF_Font* font, float xOffse
       SDL_Texture* textTexture = SDL_CreateTextureFromSurface(render, textSurface);
       SDL_Rect textRect = {SIZE - textSurface->w, 0, textSurface->w, textSurface->h};
       SDL_RenderCopy(render, textTexture, NULL, &textRect);
+      SDL_DestroyTexture(textTexture);
+      SDL_FreeSurface(textSurface);
     }
     delete[] message;
   }
   SDL_RenderPresent(render);
   auto end = std::chrono::high_resolution_clock::now();
   auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-  std::cout << "Time taken to render cells: " << elapsed.count() << "ms" << std::endl;
+  std::cout << "Time taken to render cells: " << elapsed.count() << "ms (" << tilesDrawn << " tiles redrawn)" << std::endl;
 }
-
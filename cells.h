@@ -1,3 +1,4 @@
+#pragma once
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
@@ -5,14 +6,19 @@
 #include <iostream>
 #include <sys/types.h>
 #include <SDL2/SDL_render.h>
-#include <forward_list>
+#include <SDL2/SDL_ttf.h>
 #include <fftw3.h>
 #include <x86intrin.h>
+#include "arena.h"
+#include "placement.h"
+#include "telemetry.h"
 #define SIZE 1024
 #define SEARCH_RADIUS 256
 #define AP_DURATION 8
 #define REST_DURATION 4
 #define AP_THRESHOLD 21
+// The number of threads the cell updates are split across
+#define NUM_THREADS 8
 
 enum CellType {
   // A heart cell here is represented either as a pacemaker cell, or a normal tissue cell
@@ -33,7 +39,14 @@ struct Orientation {
   float xDir;
   float yDir;
   uint cellCount;
-  std::forward_list<Cell*> cells;
+};
+
+// How the edges of the tissue behave
+enum BoundaryMode {
+  // The tissue wraps around into a torus
+  Periodic,
+  // Nothing propagates past the edges (zero-flux)
+  Insulated
 };
 
 struct Cells {
@@ -44,16 +57,45 @@ struct Cells {
   Cell* cells;
   uint numOrientations;
   Orientation* orientations;
+  // Which cells have each orientation, in compressed sparse row form: the indices of orientation i's cells are
+  // orientationCells[orientationOffsets[i]] up to (but not including) orientationCells[orientationOffsets[i + 1]],
+  // in increasing order. Not serialized, as it is rebuilt from the cells
+  uint* orientationOffsets;
+  uint* orientationCells;
+  // Not serialized, as it is a property of the simulation rather than the tissue
+  BoundaryMode boundaryMode;
+};
+
+// Mixes a cell's index, type and state into 64 bits. A grid's hash is the sum of these over its cells, so it can be
+// built up from any parts of the grid, in any order, on any thread
+inline uint64_t hashCell(uint64_t index, Cell cell) {
+  uint64_t hash = ((index << 32) ^ ((uint64_t) cell.type << 24) ^ cell.state) * 0x9E3779B97F4A7C15ULL;
+  hash ^= hash >> 32;
+  hash *= 0xD6E8FEB86659FD93ULL;
+  return hash ^ (hash >> 32);
+}
+
+// The instruction set used by the hot kernels, chosen at startup (see setSimdLevel)
+enum SimdLevel {
+  Scalar,
+  AVX2,
+  AVX512
 };
 
+// The smallest length >= n with no prime factors other than 2, 3, 5 and 7 (which FFTW handles quickly)
+uint nextFastFFTSize(uint n);
+
+// Maps a coordinate onto the grid, wrapping it if periodic, or returning -1 if it lies outside an insulated grid
+int wrapCoordinate(int coordinate, uint size, BoundaryMode mode);
+
+// Multiplies two complex arrays, storing the result (divided by normalizationFactor) in the first operand
+extern void (*multiplyComplex)(fftw_complex* array1, fftw_complex* array2, int length, double normalizationFactor);
+
 class NeighbourCounter {
   public:
     Cells* cells;
     double* stateArray;
-    double** distanceCoefficients;
-    double** distanceCoefficientsPadded;
     fftw_complex** distanceCoefficientsTransformed;
-    fftw_plan* distanceCoefficientsFFT;
     fftw_complex** neighbourArraysTransformed;
     fftw_plan* stateArrayFFT;
     fftw_plan* stateArrayIFFT;
@@ -61,107 +103,183 @@ class NeighbourCounter {
     double* neighbourArray;
     double** neighbourArrays;
     uint numOrientations;
-    NeighbourCounter(Cells* cells, double* stateArray) {
+    BoundaryMode boundaryMode;
+    // The dimensions the FFTs are done in, which are larger than the grid if it is zero-padded
+    uint fftHeight;
+    uint fftWidth;
+    // The state array copied into the zero-padded domain, or NULL if the FFTs use stateArray directly
+    double* paddedStateArray;
+    // The number of simulations counted at once, which all share the kernels of the orientations in cells.
+    // stateArray and neighbourArray hold one grid per simulation, one after another
+    uint batchSize;
+    // Everything above (other than stateArray) is carved from this
+    Arena arena;
+    NeighbourCounter(Cells* cells, double* stateArray, uint batchSize = 1) {
       this->stateArray = stateArray;
       this->cells = cells;
-      distanceCoefficients = new double*[cells->numOrientations];
-      distanceCoefficientsPadded = new double*[cells->numOrientations];
-      distanceCoefficientsTransformed = new fftw_complex*[cells->numOrientations];
-      neighbourArraysTransformed = new fftw_complex*[cells->numOrientations];
-      neighbourArrays = new double*[cells->numOrientations];
-      distanceCoefficientsFFT = new fftw_plan[cells->numOrientations];
-      stateArrayFFT = new fftw_plan[cells->numOrientations];
-      stateArrayIFFT = new fftw_plan[cells->numOrientations];
-      for (int i = 0; i < cells->numOrientations; i++) {
-        distanceCoefficients[i] = fftw_alloc_real(cells->height * cells->width);
-        distanceCoefficientsPadded[i] = fftw_alloc_real(cells->height * cells->width);
-        neighbourArrays[i] = fftw_alloc_real(cells->height * cells->width);
-        neighbourArraysTransformed[i] = fftw_alloc_complex(cells->height * (cells->width / 2 + 1));
-        distanceCoefficientsTransformed[i] = fftw_alloc_complex(cells->height * (cells->width / 2 + 1));
-        distanceCoefficientsFFT[i] = fftw_plan_dft_r2c_2d(cells->height, cells->width, distanceCoefficientsPadded[i], distanceCoefficientsTransformed[i], 0);
-        stateArrayFFT[i] = fftw_plan_dft_r2c_2d(cells->height, cells->width, stateArray, neighbourArraysTransformed[i], 0);
-        stateArrayIFFT[i] = fftw_plan_dft_c2r_2d(cells->height, cells->width, neighbourArraysTransformed[i], neighbourArrays[i], 0);
-      }
-      numOrientations = cells->numOrientations;
-      neighbourArray = fftw_alloc_real(cells->height * cells->width * numOrientations);
+      this->batchSize = batchSize;
+      allocateArrays();
       initialize();
     }
     ~NeighbourCounter() {
-      delete[] stateArrayFFT;
-      delete[] distanceCoefficientsFFT;
-      delete[] stateArrayIFFT;
-      for (int i = 0; i < cells->numOrientations; i++) {
-        fftw_free(distanceCoefficients[i]);
-        fftw_free(distanceCoefficientsPadded[i]);
-        fftw_free(distanceCoefficientsTransformed[i]);
-        fftw_free(neighbourArraysTransformed[i]);
-        fftw_free(neighbourArrays[i]);
-      }
-      delete[] distanceCoefficients;
-      delete[] distanceCoefficientsPadded;
-      delete[] neighbourArrays;
-      delete[] neighbourArraysTransformed;
-      delete[] distanceCoefficientsTransformed;
+      freeArrays();
+    }
+    // The dimensions the FFTs would be done in for a grid
+    static void calculateFFTDimensions(Cells* cells, uint* fftHeight, uint* fftWidth) {
+      if (cells->boundaryMode == BoundaryMode::Periodic) {
+        // A circular convolution over exactly the grid is what makes it wrap around
+        *fftHeight = cells->height;
+        *fftWidth = cells->width;
+      }
+      else {
+        // Padding by the kernel's reach stops activity wrapping around to the opposite edge
+        *fftHeight = nextFastFFTSize(cells->height + SEARCH_RADIUS / 2);
+        *fftWidth = nextFastFFTSize(cells->width + SEARCH_RADIUS / 2);
+      }
+    }
+    // How big the arena must be for a grid, including the scratch space needed during setup
+    static size_t calculateArenaSize(Cells* cells, uint batchSize) {
+      uint fftHeight;
+      uint fftWidth;
+      calculateFFTDimensions(cells, &fftHeight, &fftWidth);
+      size_t fftSize = fftHeight * fftWidth;
+      size_t spectrumSize = fftHeight * (fftWidth / 2 + 1);
+      size_t bytes = 0;
+      if (cells->boundaryMode == BoundaryMode::Insulated) {
+        bytes += arenaSize(sizeof(double) * fftSize * batchSize);
+      }
+      bytes += cells->numOrientations * (arenaSize(sizeof(double) * fftSize * batchSize) +
+          arenaSize(sizeof(fftw_complex) * spectrumSize * batchSize) + arenaSize(sizeof(fftw_complex) * spectrumSize));
+      bytes += arenaSize(sizeof(double) * cells->height * cells->width * cells->numOrientations * batchSize);
+      bytes += arenaSize(sizeof(double) * SEARCH_RADIUS * SEARCH_RADIUS);
+      return bytes;
     }
     void reinitialize() {
-      // If the number of orientations has changed, then all the arrays must be reinitialized
-      if (cells->numOrientations != numOrientations) {
-        numOrientations = cells->numOrientations;
-        delete[] distanceCoefficientsFFT;
-        delete[] stateArrayFFT;
-        delete[] stateArrayIFFT;
-        for (int i = 0; i < numOrientations; i++) {
-          fftw_free(distanceCoefficients[i]);
-          fftw_free(distanceCoefficientsPadded[i]);
-          fftw_free(distanceCoefficientsTransformed[i]);
-          fftw_free(neighbourArraysTransformed[i]);
-          fftw_free(neighbourArrays[i]);
-        }
-        delete[] distanceCoefficients;
-        delete[] distanceCoefficientsPadded;
-        delete[] distanceCoefficientsTransformed;
-        delete[] neighbourArraysTransformed;
-        delete[] neighbourArrays;
-        distanceCoefficients = new double*[cells->numOrientations];
-        distanceCoefficientsPadded = new double*[cells->numOrientations];
-        distanceCoefficientsTransformed = new fftw_complex*[cells->numOrientations];
-        neighbourArraysTransformed = new fftw_complex*[cells->numOrientations];
-        neighbourArrays = new double*[cells->numOrientations];
-        distanceCoefficientsFFT = new fftw_plan[cells->numOrientations];
-        stateArrayFFT = new fftw_plan[cells->numOrientations];
-        stateArrayIFFT = new fftw_plan[cells->numOrientations];
-        for (int i = 0; i < cells->numOrientations; i++) {
-          distanceCoefficients[i] = fftw_alloc_real(cells->height * cells->width);
-          distanceCoefficientsPadded[i] = fftw_alloc_real(cells->height * cells->width);
-          neighbourArrays[i] = fftw_alloc_real(cells->height * cells->width);
-          neighbourArraysTransformed[i] = fftw_alloc_complex(cells->height * (cells->width / 2 + 1));
-          distanceCoefficientsTransformed[i] = fftw_alloc_complex(cells->height * (cells->width / 2 + 1));
-          distanceCoefficientsFFT[i] = fftw_plan_dft_r2c_2d(cells->height, cells->width, distanceCoefficientsPadded[i], distanceCoefficientsTransformed[i], 0);
-          stateArrayFFT[i] = fftw_plan_dft_r2c_2d(cells->height, cells->width, stateArray, neighbourArraysTransformed[i], 0);
-          stateArrayIFFT[i] = fftw_plan_dft_c2r_2d(cells->height, cells->width, neighbourArraysTransformed[i], neighbourArrays[i], 0);
-        }
+      // If the number of orientations, the grid size or the boundary has changed, then all the arrays must be reinitialized
+      if (cells->numOrientations != numOrientations || cells->boundaryMode != boundaryMode ||
+          cells->height != gridHeight || cells->width != gridWidth) {
+        freeArrays();
+        allocateArrays();
       }
       initialize();
     }
 
     void calculateNeighbourCounts() {
       // TODO: switch to standard convolution if the number of cells is low enough
+      size_t gridSize = gridHeight * gridWidth;
+      size_t fftSize = fftHeight * fftWidth;
+      size_t spectrumSize = fftHeight * (fftWidth / 2 + 1);
+      if (paddedStateArray != NULL) {
+        // The padding around the grid is zeroed once on allocation, so only the grid itself needs copying
+        for (int b = 0; b < batchSize; b++) {
+          for (int i = 0; i < gridHeight; i++) {
+            memcpy(&paddedStateArray[b * fftSize + i * fftWidth], &stateArray[b * gridSize + i * gridWidth], sizeof(double) * gridWidth);
+          }
+        }
+      }
       for (int i = 0; i < numOrientations; i++) {
+        // Each of these transforms the whole batch at once
         fftw_execute(stateArrayFFT[i]);
-        multiply(neighbourArraysTransformed[i], distanceCoefficientsTransformed[i]);
+        for (int b = 0; b < batchSize; b++) {
+          multiply(&neighbourArraysTransformed[i][b * spectrumSize], distanceCoefficientsTransformed[i]);
+        }
         fftw_execute(stateArrayIFFT[i]);
       }
-      for (int i = 0; i < cells->height * cells->width; i++) {
-        for (int j = 0; j < numOrientations; j++) {
-          neighbourArray[(i * numOrientations) + j] = neighbourArrays[j][i];
+      if (batchSize == 1 && numOrientations > 1) {
+        // Each cell only reads the count for its own orientation, so only those are copied out, one orientation at a
+        // time. The members of a batch can each orient their cells differently, so they copy every count
+        for (int k = 0; k < numOrientations; k++) {
+          for (uint j = cells->orientationOffsets[k]; j < cells->orientationOffsets[k + 1]; j++) {
+            uint cell = cells->orientationCells[j];
+            neighbourArray[(size_t) cell * numOrientations + k] = neighbourArrays[k][(cell / gridWidth) * fftWidth + cell % gridWidth];
+          }
+        }
+        return;
+      }
+      for (int b = 0; b < batchSize; b++) {
+        double* batchNeighbourArray = &neighbourArray[b * gridSize * numOrientations];
+        for (int i = 0; i < gridHeight; i++) {
+          for (int j = 0; j < gridWidth; j++) {
+            for (int k = 0; k < numOrientations; k++) {
+              batchNeighbourArray[((i * gridWidth + j) * numOrientations) + k] = neighbourArrays[k][b * fftSize + i * fftWidth + j];
+            }
+          }
         }
       }
     }
   private:
+    uint gridHeight;
+    uint gridWidth;
+    void allocateArrays() {
+      numOrientations = cells->numOrientations;
+      boundaryMode = cells->boundaryMode;
+      gridHeight = cells->height;
+      gridWidth = cells->width;
+      calculateFFTDimensions(cells, &fftHeight, &fftWidth);
+      int fftDimensions[2] = {(int) fftHeight, (int) fftWidth};
+      int fftSize = fftHeight * fftWidth;
+      int spectrumSize = fftHeight * (fftWidth / 2 + 1);
+      arena = createArena(calculateArenaSize(cells, batchSize));
+      paddedStateArray = NULL;
+      if (boundaryMode == BoundaryMode::Insulated) {
+        paddedStateArray = (double*) arenaAllocate(&arena, sizeof(double) * fftSize * batchSize, "Zero-padded states");
+      }
+      double* fftInput = paddedStateArray != NULL ? paddedStateArray : stateArray;
+      distanceCoefficientsTransformed = new fftw_complex*[numOrientations];
+      neighbourArraysTransformed = new fftw_complex*[numOrientations];
+      neighbourArrays = new double*[numOrientations];
+      stateArrayFFT = new fftw_plan[numOrientations];
+      stateArrayIFFT = new fftw_plan[numOrientations];
+      for (int i = 0; i < numOrientations; i++) {
+        neighbourArrays[i] = (double*) arenaAllocate(&arena, sizeof(double) * fftSize * batchSize, "Convolution outputs");
+        neighbourArraysTransformed[i] = (fftw_complex*) arenaAllocate(&arena, sizeof(fftw_complex) * spectrumSize * batchSize, "State spectra");
+        distanceCoefficientsTransformed[i] = (fftw_complex*) arenaAllocate(&arena, sizeof(fftw_complex) * spectrumSize, "Kernel spectra");
+        stateArrayFFT[i] = fftw_plan_many_dft_r2c(2, fftDimensions, batchSize, fftInput, NULL, 1, fftSize, neighbourArraysTransformed[i], NULL, 1, spectrumSize, 0);
+        stateArrayIFFT[i] = fftw_plan_many_dft_c2r(2, fftDimensions, batchSize, neighbourArraysTransformed[i], NULL, 1, spectrumSize, neighbourArrays[i], NULL, 1, fftSize, 0);
+      }
+      // Planning overwrites the FFT inputs, so the padding is only zeroed afterwards (and stateArray must be refilled by the caller)
+      if (paddedStateArray != NULL) {
+        std::fill_n(paddedStateArray, fftSize * batchSize, 0.0);
+      }
+      neighbourArray = (double*) arenaAllocate(&arena, sizeof(double) * gridHeight * gridWidth * numOrientations * batchSize, "Neighbour counts");
+      placeArrays();
+      telemetry.arenaBytes.store(arena.capacity, std::memory_order_relaxed);
+    }
+    // Puts the rows of each simulation's arrays on the NUMA node of the workers which use them
+    void placeArrays() {
+      size_t fftSize = fftHeight * fftWidth;
+      size_t spectrumSize = fftHeight * (fftWidth / 2 + 1);
+      for (int b = 0; b < batchSize; b++) {
+        placeRows(&neighbourArray[b * gridHeight * gridWidth * numOrientations], sizeof(double) * gridWidth * numOrientations, gridHeight, gridHeight);
+        if (paddedStateArray != NULL) {
+          placeRows(&paddedStateArray[b * fftSize], sizeof(double) * fftWidth, fftHeight, gridHeight);
+        }
+        for (int i = 0; i < numOrientations; i++) {
+          placeRows(&neighbourArrays[i][b * fftSize], sizeof(double) * fftWidth, fftHeight, gridHeight);
+          placeRows(&neighbourArraysTransformed[i][b * spectrumSize], sizeof(fftw_complex) * (fftWidth / 2 + 1), fftHeight, gridHeight);
+        }
+      }
+    }
+    void freeArrays() {
+      for (int i = 0; i < numOrientations; i++) {
+        fftw_destroy_plan(stateArrayFFT[i]);
+        fftw_destroy_plan(stateArrayIFFT[i]);
+      }
+      delete[] stateArrayFFT;
+      delete[] stateArrayIFFT;
+      delete[] distanceCoefficientsTransformed;
+      delete[] neighbourArraysTransformed;
+      delete[] neighbourArrays;
+      freeArena(&arena);
+    }
     void calculateDistanceCoefficients(Orientation orientation, double* coefficients) {
       for (int i = 0; i < SEARCH_RADIUS; i++) {
         for (int j = 0; j < SEARCH_RADIUS; j++) {
-          if (i == SEARCH_RADIUS / 2 && j == SEARCH_RADIUS / 2) continue;
+          if (i == SEARCH_RADIUS / 2 && j == SEARCH_RADIUS / 2) {
+            // A cell is not its own neighbour
+            coefficients[(i * SEARCH_RADIUS) + j] = 0.0;
+            continue;
+          }
           double xCoord = (j - SEARCH_RADIUS / 2.0);
           double yCoord = (i - SEARCH_RADIUS / 2.0);
           double distance = xCoord * xCoord + yCoord * yCoord;
@@ -204,46 +322,65 @@ class NeighbourCounter {
     }
     // Multiplies two complex arrays, storing the result in the first operand
     void multiply(fftw_complex* array1, fftw_complex* array2) {
-      __m256d normalizationFactor;
-      __m256d array1Real;
-      __m256d array1Imag;
-      __m256d array2Real;
-      __m256d array2Imag;
-      __m256d realResult;
-      __m256d imagResult;
-      double real[4];
-      double imag[4];
-      for (int i = 0; i < cells->height * (cells->width / 2 + 1); i += 4) {
-        normalizationFactor = _mm256_set1_pd(cells->height * cells->width);
-        array1Real = _mm256_set_pd(array1[i + 3][0], array1[i + 2][0], array1[i + 1][0], array1[i][0]);
-        array1Imag = _mm256_set_pd(array1[i + 3][1], array1[i + 2][1], array1[i + 1][1], array1[i][1]);
-        array2Real = _mm256_set_pd(array2[i + 3][0], array2[i + 2][0], array2[i + 1][0], array2[i][0]);
-        array2Imag = _mm256_set_pd(array2[i + 3][1], array2[i + 2][1], array2[i + 1][1], array2[i][1]);
-        realResult = _mm256_sub_pd(_mm256_mul_pd(array1Real, array2Real), _mm256_mul_pd(array1Imag, array2Imag));
-        imagResult = _mm256_add_pd(_mm256_mul_pd(array1Real, array2Imag), _mm256_mul_pd(array1Imag, array2Real));
-        realResult = _mm256_div_pd(realResult, normalizationFactor);
-        imagResult = _mm256_div_pd(imagResult, normalizationFactor);
-        _mm256_storeu_pd(real, realResult);
-        _mm256_storeu_pd(imag, imagResult);
-        for (int j = 0; j < 4; j++) {
-          array1[i + j][0] = real[j];
-          array1[i + j][1] = imag[j];
-        }
-      }
+      multiplyComplex(array1, array2, fftHeight * (fftWidth / 2 + 1), fftHeight * fftWidth);
     }
     // Calculates all the convolutions, shifts them, and transforms them
     void initialize() {
+      if (numOrientations == 0) {
+        return;
+      }
+      // The kernels are only needed to build their spectra, so each is built in scratch space which is released
+      // afterwards, and padded out in the first convolution output (which is overwritten on every step anyway)
+      size_t mark = arena.used;
+      double* distanceCoefficients = (double*) arenaAllocate(&arena, sizeof(double) * SEARCH_RADIUS * SEARCH_RADIUS, "Kernel setup");
+      double* distanceCoefficientsPadded = neighbourArrays[0];
+      // Planning overwrites the input, so is done before any kernel is written
+      fftw_plan distanceCoefficientsFFT = fftw_plan_dft_r2c_2d(fftHeight, fftWidth, distanceCoefficientsPadded, distanceCoefficientsTransformed[0], 0);
       for (int i = 0; i < numOrientations; i++) {
-        calculateDistanceCoefficients(cells->orientations[i], distanceCoefficients[i]);
-        shiftConvolution(distanceCoefficients[i], distanceCoefficientsPadded[i], SEARCH_RADIUS, cells->height, cells->width);
-        fftw_execute(distanceCoefficientsFFT[i]);
+        calculateDistanceCoefficients(cells->orientations[i], distanceCoefficients);
+        std::fill_n(distanceCoefficientsPadded, fftHeight * fftWidth, 0.0);
+        shiftConvolution(distanceCoefficients, distanceCoefficientsPadded, SEARCH_RADIUS, fftHeight, fftWidth);
+        fftw_execute_dft_r2c(distanceCoefficientsFFT, distanceCoefficientsPadded, distanceCoefficientsTransformed[i]);
       }
+      fftw_destroy_plan(distanceCoefficientsFFT);
+      arenaRelease(&arena, mark);
     }
 };
 
 const char* cellTypeToString(CellType type);
 
-void advanceCells(Cells cells, int* searchOffsets, int offsetLength);
+class TileActivity;
+
+// Advances the simulation by one step, only updating the tiles which could change
+void advanceCells(Cells* currentState, NeighbourCounter* neighbourCounter, TileActivity* tiles);
+
+// Updates the cells in [start, end), using whichever kernel setSimdLevel selected.
+// Returns true if every one of those cells is quiescent afterwards
+extern bool (*updateCellsArea)(Cells* currentState, double* distanceArray, double* stateArray, int start, int end);
+
+// The best instruction set supported by the CPU this is running on
+SimdLevel detectSimdLevel();
+
+const char* simdLevelToString(SimdLevel level);
+
+// Returns false if the name is not one of "scalar", "avx2" or "avx512"
+bool parseSimdLevel(const char* name, SimdLevel* level);
+
+// Switches all the kernels over to the given instruction set
+void setSimdLevel(SimdLevel level);
+
+// A grid of inactive normal tissue, with a single horizontal orientation
+Cells createDefaultCells(uint width, uint height);
+
+// Frees a grid made by createDefaultCells or readCells
+void freeCells(Cells cells);
+
+// Rebuilds the orientation index and each orientation's cellCount from the cells' orientationIndex.
+// Cells with an orientation which does not exist are left out
+void buildOrientationIndex(Cells* cells);
+
+// Sets each cell's entry in the state array from how much it counts towards its neighbours
+void fillStateArray(Cells cells, double* stateArray);
 
 // Turn a 2D array of cells into a 1D array of bytes (i.e. for dumping to a file)
 unsigned char* serializeCells(Cells cells);
@@ -251,4 +388,28 @@ unsigned char* serializeCells(Cells cells);
 // Inverse of serializeCells
 Cells readCells(unsigned char* serializedCells);
 
-void renderCells(Cells cells, SDL_Renderer* renderer, int xOffset, int yOffset, float zoomFactor);
+// Reads a dump written by saveCellsToFile. Returns false (having said why) if the file cannot be read, or is not a
+// complete dump
+bool readCellsFromFile(const char* fileName, Cells* cells);
+
+// The colour (as ARGB) a packed (type << 4) | state is drawn in, by the renderer and the exporter alike. Cells which
+// count towards their neighbours are red, or magenta for types which fire on their own (such as pacemakers), and
+// the rest are black
+uint32_t cellColour(uint8_t packed);
+
+// The grid as last drawn, so that only the tiles which have changed need to be drawn again
+struct RenderCache {
+  SDL_Texture* texture;
+  // One ARGB pixel per cell
+  uint32_t* pixels;
+  uint width;
+  uint height;
+};
+
+RenderCache createRenderCache(SDL_Renderer* renderer, Cells cells);
+
+void freeRenderCache(RenderCache* cache);
+
+// Draws the cells, redrawing the tiles marked as dirty first
+void renderCells(Cells cells, RenderCache* cache, TileActivity* tiles, SDL_Renderer* render, TTF_Font* font, float xOffset, float yOffset, float zoomFactor,
+    int selectedCellI, int selectedCellJ, int firstCornerX, int secondCornerX, int firstCornerY, int secondCornerY);
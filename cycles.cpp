@@ -0,0 +1,47 @@
+#include "cycles.h"
+
+CycleDetector createCycleDetector(uint historySize) {
+  CycleDetector detector;
+  detector.historySize = historySize;
+  detector.recentHashes.assign(historySize, 0);
+  detector.cycleLength = 0;
+  detector.matchingSteps = 0;
+  detector.isConfirmed = false;
+  return detector;
+}
+
+bool recordStepHash(CycleDetector* detector, uint step, uint64_t hash) {
+  uint64_t* slot = &detector->recentHashes[step % detector->historySize];
+  // Forget the hash which this one replaces in the history, if it has not been seen since
+  if (step >= detector->historySize) {
+    auto oldest = detector->stepsByHash.find(*slot);
+    if (oldest != detector->stepsByHash.end() && oldest->second == step - detector->historySize) {
+      detector->stepsByHash.erase(oldest);
+    }
+  }
+  if (detector->cycleLength != 0) {
+    if (hash == detector->recentHashes[(step - detector->cycleLength) % detector->historySize]) {
+      detector->matchingSteps++;
+    }
+    else {
+      // Either the hashes collided, or the grid was edited
+      detector->cycleLength = 0;
+      detector->isConfirmed = false;
+    }
+  }
+  if (detector->cycleLength == 0) {
+    auto previous = detector->stepsByHash.find(hash);
+    if (previous != detector->stepsByHash.end()) {
+      detector->cycleLength = step - previous->second;
+      detector->matchingSteps = 1;
+    }
+  }
+  bool isNewlyConfirmed = false;
+  if (detector->cycleLength != 0 && !detector->isConfirmed && detector->matchingSteps >= detector->cycleLength) {
+    detector->isConfirmed = true;
+    isNewlyConfirmed = true;
+  }
+  *slot = hash;
+  detector->stepsByHash[hash] = step;
+  return isNewlyConfirmed;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+// Spots when a simulation returns to a grid it has been in before. The simulation is deterministic, so from then on
+// it repeats with that period (unless the grid is edited). A recurrence is only confirmed once the whole cycle has
+// repeated, which rules out the hashes having collided
+struct CycleDetector {
+  // The step each of the last historySize hashes was seen at
+  std::unordered_map<uint64_t, uint> stepsByHash;
+  std::vector<uint64_t> recentHashes;
+  uint historySize;
+  // The length of the cycle which is being confirmed or has been confirmed, or 0 if there is none
+  uint cycleLength;
+  // How many steps in a row have matched the step cycleLength before them
+  uint matchingSteps;
+  bool isConfirmed;
+};
+
+CycleDetector createCycleDetector(uint historySize);
+
+// Records the grid's hash after the given step, where steps are numbered consecutively.
+// Returns true at the step a cycle is confirmed
+bool recordStepHash(CycleDetector* detector, uint step, uint64_t hash);
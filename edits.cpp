@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "edits.h"
+#include "tiles.h"
+
+EditCommand createCellEdit(EditType type, int row, int column) {
+  return createAreaEdit(type, row, column, row + 1, column + 1);
+}
+
+EditCommand createAreaEdit(EditType type, int firstRow, int firstColumn, int lastRow, int lastColumn) {
+  EditCommand command;
+  command.type = type;
+  command.firstRow = firstRow;
+  command.firstColumn = firstColumn;
+  command.lastRow = lastRow;
+  command.lastColumn = lastColumn;
+  return command;
+}
+
+EditCommand createShockEdit() {
+  return createAreaEdit(EditType::Shock, 0, 0, 0, 0);
+}
+
+EditTargets findEditTargets(const CellModel& model) {
+  EditTargets targets;
+  for (uint type = 0; type < MAX_CELL_TYPES; type++) {
+    targets.firedStates[type] = -1;
+    targets.toggledTypes[type] = -1;
+  }
+  for (uint type = 0; type < model.numTypes; type++) {
+    uint8_t fired = model.transitions[1][type << 4];
+    if (fired >> 4 == type && fired != type << 4) {
+      targets.firedStates[type] = fired;
+    }
+  }
+  // A type which fires rests as the type its action potential ends in (state 1), and toggles with that type
+  for (uint type = 0; type < model.numTypes; type++) {
+    uint restingType = model.transitions[0][(type << 4) | 1] >> 4;
+    if (targets.firedStates[type] != -1 && restingType != type && targets.firedStates[restingType] == -1) {
+      targets.toggledTypes[type] = restingType;
+      targets.toggledTypes[restingType] = type;
+    }
+  }
+  return targets;
+}
+
+bool isRestingType(const EditTargets& targets, uint type) {
+  return targets.toggledTypes[type] != -1 && targets.firedStates[type] == -1;
+}
+
+void applyEdit(EditCommand edit, Cells* cells, double* stateArray, TileActivity* tiles) {
+  EditTargets targets = findEditTargets(cellModel);
+  if (edit.type == EditType::Shock) {
+    for (int i = 0; i < cells->height * cells->width; i++) {
+      int fired = targets.firedStates[cells->cells[i].type];
+      if (fired != -1) {
+        cells->cells[i].state = fired & 0xF;
+        stateArray[i] = cellModel.contributions[fired];
+      }
+    }
+    if (tiles != NULL) {
+      tiles->markAllActive();
+    }
+    return;
+  }
+  // The grid may have been replaced since the edit was queued
+  int firstRow = std::max(edit.firstRow, 0);
+  int firstColumn = std::max(edit.firstColumn, 0);
+  int lastRow = std::min(edit.lastRow, (int) cells->height);
+  int lastColumn = std::min(edit.lastColumn, (int) cells->width);
+  if (firstRow >= lastRow || firstColumn >= lastColumn) {
+    return;
+  }
+  // Done a row at a time, with the type of edit hoisted out of the inner loops. The state array is kept as
+  // fillStateArray would make it, from the contribution of each cell's new type and state
+  for (int i = firstRow; i < lastRow; i++) {
+    Cell* row = &cells->cells[i * cells->width];
+    double* stateRow = &stateArray[i * cells->width];
+    switch (edit.type) {
+      case EditType::Stimulate:
+        for (int j = firstColumn; j < lastColumn; j++) {
+          int fired = targets.firedStates[row[j].type];
+          if (fired != -1) {
+            row[j].state = fired & 0xF;
+            stateRow[j] = cellModel.contributions[fired];
+          }
+        }
+        break;
+      case EditType::Clear:
+        for (int j = firstColumn; j < lastColumn; j++) {
+          if (targets.firedStates[row[j].type] != -1) {
+            row[j].state = 0;
+            stateRow[j] = cellModel.contributions[row[j].type << 4];
+          }
+        }
+        break;
+      case EditType::ToggleResting:
+        for (int j = firstColumn; j < lastColumn; j++) {
+          int toggled = targets.toggledTypes[row[j].type];
+          if (toggled != -1) {
+            row[j].type = (CellType) toggled;
+            stateRow[j] = cellModel.contributions[(toggled << 4) | row[j].state];
+          }
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  if (tiles != NULL) {
+    tiles->markAreaActive(firstRow, firstColumn, lastRow, lastColumn);
+  }
+}
+
+uint applyQueuedEdits(EditQueue* queue, Cells* cells, double* stateArray, TileActivity* tiles) {
+  uint numEdits = 0;
+  EditCommand edit;
+  while (queue->pop(&edit)) {
+    applyEdit(edit, cells, stateArray, tiles);
+    numEdits++;
+  }
+  return numEdits;
+}
+
+bool readStimulusScript(const char* fileName, std::vector<ScriptedEdit>* script) {
+  std::ifstream inputStream(fileName);
+  if (!inputStream.is_open()) {
+    std::cout << "Could not open stimulus script " << fileName << std::endl;
+    return false;
+  }
+  script->clear();
+  std::string line;
+  int lineNumber = 0;
+  while (std::getline(inputStream, line)) {
+    lineNumber++;
+    std::istringstream lineStream(line);
+    std::string first;
+    if (!(lineStream >> first) || first[0] == '#') {
+      continue;
+    }
+    ScriptedEdit scriptedEdit;
+    std::string name;
+    std::istringstream stepStream(first);
+    if (!(stepStream >> scriptedEdit.step) || !(lineStream >> name)) {
+      std::cout << fileName << ":" << lineNumber << ": expected a step and an edit" << std::endl;
+      return false;
+    }
+    if (name == "shock") {
+      scriptedEdit.command = createShockEdit();
+      script->push_back(scriptedEdit);
+      continue;
+    }
+    EditType type;
+    if (name == "stimulate") {
+      type = EditType::Stimulate;
+    }
+    else if (name == "clear") {
+      type = EditType::Clear;
+    }
+    else if (name == "toggle") {
+      type = EditType::ToggleResting;
+    }
+    else {
+      std::cout << fileName << ":" << lineNumber << ": unknown edit " << name << std::endl;
+      return false;
+    }
+    int x;
+    int y;
+    if (!(lineStream >> x >> y)) {
+      std::cout << fileName << ":" << lineNumber << ": expected the coordinates of the edit" << std::endl;
+      return false;
+    }
+    int width = 1;
+    int height = 1;
+    lineStream >> width >> height;
+    scriptedEdit.command = createAreaEdit(type, y, x, y + height, x + width);
+    script->push_back(scriptedEdit);
+  }
+  // Edits for the same step keep the order they were written in
+  std::stable_sort(script->begin(), script->end(), [](const ScriptedEdit& a, const ScriptedEdit& b) { return a.step < b.step; });
+  return true;
+}
+
+bool pushScriptedEdits(const std::vector<ScriptedEdit>& script, size_t* nextEdit, uint step, EditQueue* queue) {
+  while (*nextEdit < script.size() && script[*nextEdit].step <= step) {
+    if (!queue->push(script[*nextEdit].command)) {
+      return false;
+    }
+    (*nextEdit)++;
+  }
+  return true;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include "cellmodel.h"
+#include "cells.h"
+
+// Must be a power of two
+#define EDIT_QUEUE_SIZE 1024
+
+// What each edit does is worked out from the cell model (see EditTargets), so that the edits also work with loaded models
+enum EditType : uint8_t {
+  // Fires the cells, as if their neighbours had been active enough (left click)
+  Stimulate,
+  // Sets the cells' state to 0, unless they are resting (right click)
+  Clear,
+  // Swaps the cells between an active type and the type it rests as, such as normal and resting tissue (middle click)
+  ToggleResting,
+  // Fires every cell (G), ignoring the area
+  Shock
+};
+
+// A change to the grid, over the rows [firstRow, lastRow) and columns [firstColumn, lastColumn)
+struct EditCommand {
+  EditType type;
+  int firstRow;
+  int firstColumn;
+  int lastRow;
+  int lastColumn;
+};
+
+EditCommand createCellEdit(EditType type, int row, int column);
+
+EditCommand createAreaEdit(EditType type, int firstRow, int firstColumn, int lastRow, int lastColumn);
+
+EditCommand createShockEdit();
+
+// A bounded, lock-free queue of edits, which any number of threads (the UI, scripts) may push to, while the
+// simulation thread pops them at the start of each step. Each slot has a sequence number, which says whether
+// it is ready to be written or read for a given position in the queue
+class EditQueue {
+  public:
+    EditQueue() {
+      for (size_t i = 0; i < EDIT_QUEUE_SIZE; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      head.store(0, std::memory_order_relaxed);
+      tail.store(0, std::memory_order_relaxed);
+    }
+    // Returns false if the queue is full
+    bool push(EditCommand command) {
+      size_t position = tail.load(std::memory_order_relaxed);
+      while (true) {
+        EditQueueSlot* slot = &slots[position & (EDIT_QUEUE_SIZE - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+          // The slot is free, so claim it (if no other producer has first)
+          if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            slot->command = command;
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (sequence < position) {
+          // The consumer has not got to this slot since it was last written
+          return false;
+        }
+        else {
+          position = tail.load(std::memory_order_relaxed);
+        }
+      }
+    }
+    // Returns false if the queue is empty. Only one thread may pop
+    bool pop(EditCommand* command) {
+      size_t position = head.load(std::memory_order_relaxed);
+      EditQueueSlot* slot = &slots[position & (EDIT_QUEUE_SIZE - 1)];
+      if (slot->sequence.load(std::memory_order_acquire) != position + 1) {
+        return false;
+      }
+      *command = slot->command;
+      slot->sequence.store(position + EDIT_QUEUE_SIZE, std::memory_order_release);
+      head.store(position + 1, std::memory_order_relaxed);
+      return true;
+    }
+  private:
+    struct EditQueueSlot {
+      std::atomic<size_t> sequence;
+      EditCommand command;
+    };
+    EditQueueSlot slots[EDIT_QUEUE_SIZE];
+    // Kept on separate cache lines, as they are written by different threads
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+// How the edits change each type of cell, from the transitions of the cell model
+struct EditTargets {
+  // The (type << 4) | state that a cell of each type fires into from state 0, or -1 for types which do not fire
+  // (those which rest as another type, or never change). Only these are stimulated or cleared
+  int firedStates[MAX_CELL_TYPES];
+  // The type that each type swaps with when toggled, or -1 if it has none
+  int toggledTypes[MAX_CELL_TYPES];
+};
+
+EditTargets findEditTargets(const CellModel& model);
+
+// Whether a type is the one that another type rests as (such as resting tissue)
+bool isRestingType(const EditTargets& targets, uint type);
+
+// Applies an edit to a grid and its state array, marking the tiles it touches as active (if tiles is not NULL)
+void applyEdit(EditCommand edit, Cells* cells, double* stateArray, TileActivity* tiles);
+
+// Pops every queued edit, and applies them in order. Must only be called between steps.
+// Returns the number of edits applied
+uint applyQueuedEdits(EditQueue* queue, Cells* cells, double* stateArray, TileActivity* tiles);
+
+// An edit to push once a given number of steps have been taken
+struct ScriptedEdit {
+  uint step;
+  EditCommand command;
+};
+
+// Reads a stimulus script, with one edit per line in the form
+//   <step> stimulate|clear|toggle <x> <y> [width height]
+//   <step> shock
+// where an edit for step n is applied once n steps have been taken.
+// Lines starting with # are comments. Returns false if the file is invalid
+bool readStimulusScript(const char* fileName, std::vector<ScriptedEdit>* script);
+
+// Pushes the edits up to and including step, starting from *nextEdit. Returns false if the queue filled up
+// first, in which case it must be emptied before calling this again
+bool pushScriptedEdits(const std::vector<ScriptedEdit>& script, size_t* nextEdit, uint step, EditQueue* queue);
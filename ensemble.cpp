@@ -0,0 +1,330 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fftw3.h>
+#include "cycles.h"
+#include "ensemble.h"
+
+// Places a 7x7 block of pacemaker cells centred on (x, y)
+void addPacemaker(Cells cells, int x, int y) {
+  for (int i = y - 3; i <= y + 3; i++) {
+    for (int j = x - 3; j <= x + 3; j++) {
+      int wrappedI = wrapCoordinate(i, cells.height, cells.boundaryMode);
+      int wrappedJ = wrapCoordinate(j, cells.width, cells.boundaryMode);
+      if (wrappedI != -1 && wrappedJ != -1) {
+        cells.cells[wrappedI * cells.width + wrappedJ].type = CellType::Pacemaker;
+      }
+    }
+  }
+}
+
+EnsembleMember* readEnsembleFile(const char* fileName, BoundaryMode boundaryMode, uint* numMembers) {
+  std::ifstream inputStream(fileName);
+  if (!inputStream.is_open()) {
+    std::cout << "Could not open ensemble file " << fileName << std::endl;
+    return NULL;
+  }
+  std::vector<EnsembleMember> members;
+  std::string line;
+  while (std::getline(inputStream, line)) {
+    std::istringstream lineStream(line);
+    std::string source;
+    if (!(lineStream >> source) || source[0] == '#') {
+      continue;
+    }
+    EnsembleMember member;
+    if (source == "blank") {
+      member.cells = createDefaultCells(SIZE, SIZE);
+    }
+    else if (!readCellsFromFile(source.c_str(), &member.cells)) {
+      std::cout << "Could not read ensemble member " << members.size() << " from " << fileName << std::endl;
+      for (int j = 0; j < members.size(); j++) {
+        freeCells(members[j].cells);
+      }
+      return NULL;
+    }
+    member.cells.boundaryMode = boundaryMode;
+    int pacemakerX;
+    int pacemakerY;
+    if (lineStream >> pacemakerX >> pacemakerY) {
+      addPacemaker(member.cells, pacemakerX, pacemakerY);
+    }
+    member.activeCells = 0;
+    member.restingCells = 0;
+    member.stateHash = 0;
+    members.push_back(member);
+  }
+  if (members.empty()) {
+    std::cout << "The ensemble file " << fileName << " has no members" << std::endl;
+    return NULL;
+  }
+  // The kernels are shared, so every member must match the first one
+  Cells first = members[0].cells;
+  for (int i = 1; i < members.size(); i++) {
+    Cells current = members[i].cells;
+    bool matches = current.width == first.width && current.height == first.height && current.numOrientations == first.numOrientations;
+    for (int j = 0; matches && j < first.numOrientations; j++) {
+      matches = current.orientations[j].xDir == first.orientations[j].xDir && current.orientations[j].yDir == first.orientations[j].yDir;
+    }
+    if (!matches) {
+      std::cout << "Ensemble member " << i << " does not have the same grid size and orientations as member 0" << std::endl;
+      for (int j = 0; j < members.size(); j++) {
+        freeCells(members[j].cells);
+      }
+      return NULL;
+    }
+  }
+  *numMembers = members.size();
+  EnsembleMember* output = new EnsembleMember[members.size()];
+  std::copy(members.begin(), members.end(), output);
+  return output;
+}
+
+// Updates the cells in [start, end) of the whole ensemble (indexed as member * cells per member + cell), which may span several members.
+// The statistics and hashes for each member are accumulated into activeCells, restingCells and stateHashes
+void updateEnsembleArea(EnsembleMember* members, NeighbourCounter* neighbourCounter, long start, long end, uint* activeCells, uint* restingCells, uint64_t* stateHashes) {
+  long numCells = members[0].cells.width * members[0].cells.height;
+  uint numOrientations = neighbourCounter->numOrientations;
+  // Resting cells are those of the types which the model's other types rest as
+  EditTargets targets = findEditTargets(cellModel);
+  while (start < end) {
+    long member = start / numCells;
+    long memberStart = start - member * numCells;
+    long memberEnd = std::min(end - member * numCells, numCells);
+    Cells* cells = &members[member].cells;
+    updateCellsArea(cells, &neighbourCounter->neighbourArray[member * numCells * numOrientations], &neighbourCounter->stateArray[member * numCells], memberStart, memberEnd);
+    for (long i = memberStart; i < memberEnd; i++) {
+      stateHashes[member] += hashCell(i, cells->cells[i]);
+      if (isRestingType(targets, cells->cells[i].type)) {
+        restingCells[member]++;
+      }
+      else if (cellModel.contributions[(cells->cells[i].type << 4) | cells->cells[i].state] > 0) {
+        activeCells[member]++;
+      }
+    }
+    start = member * numCells + memberEnd;
+  }
+}
+
+void advanceEnsemble(EnsembleMember* members, uint numMembers, NeighbourCounter* neighbourCounter) {
+  auto start = std::chrono::high_resolution_clock::now();
+  auto stepStart = std::chrono::steady_clock::now();
+  neighbourCounter->calculateNeighbourCounts();
+  auto stageStart = recordStage(TelemetryStage::FFTStage, stepStart);
+  // The threads split the cells of all the members between them, rather than one member per thread,
+  // so that the work is balanced whatever the number of members
+  std::thread threads[NUM_THREADS];
+  uint* activeCells = new uint[NUM_THREADS * numMembers]();
+  uint* restingCells = new uint[NUM_THREADS * numMembers]();
+  uint64_t* stateHashes = new uint64_t[NUM_THREADS * numMembers]();
+  long numCells = (long) members[0].cells.width * members[0].cells.height * numMembers;
+  // Keep the boundaries between threads on a multiple of 16 cells, so the SIMD kernels rarely need their scalar tail
+  long delta = (numCells / NUM_THREADS) & ~15L;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    long end = (i == NUM_THREADS - 1) ? numCells : delta * (i + 1);
+    threads[i] = std::thread(updateEnsembleArea, members, neighbourCounter, delta * i, end, &activeCells[i * numMembers], &restingCells[i * numMembers], &stateHashes[i * numMembers]);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    threads[i].join();
+  }
+  for (int i = 0; i < numMembers; i++) {
+    members[i].activeCells = 0;
+    members[i].restingCells = 0;
+    members[i].stateHash = 0;
+    for (int j = 0; j < NUM_THREADS; j++) {
+      members[i].activeCells += activeCells[j * numMembers + i];
+      members[i].restingCells += restingCells[j * numMembers + i];
+      members[i].stateHash += stateHashes[j * numMembers + i];
+    }
+  }
+  delete[] activeCells;
+  delete[] restingCells;
+  delete[] stateHashes;
+  recordStage(TelemetryStage::UpdateStage, stageStart);
+  recordStage(TelemetryStage::StepStage, stepStart);
+  uint64_t totalActiveCells = 0;
+  for (int i = 0; i < numMembers; i++) {
+    totalActiveCells += members[i].activeCells;
+  }
+  telemetry.activeCells.store(totalActiveCells, std::memory_order_relaxed);
+  telemetry.stepsTaken.fetch_add(1, std::memory_order_relaxed);
+  auto end = std::chrono::high_resolution_clock::now();
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  std::cout << "Time taken to calculate ensemble of " << numMembers << ": " << elapsed.count() << "ms" << std::endl;
+}
+
+// Applies the queued edits to every member
+void applyEnsembleEdits(EditQueue* editQueue, EnsembleMember* members, uint numMembers, double* stateArrays) {
+  uint numCells = members[0].cells.width * members[0].cells.height;
+  EditCommand edit;
+  while (editQueue->pop(&edit)) {
+    for (int i = 0; i < numMembers; i++) {
+      applyEdit(edit, &members[i].cells, &stateArrays[i * numCells], NULL);
+    }
+  }
+}
+
+// The resting column is left out for models which have no resting types
+void writeStatsRow(std::ofstream& statsStream, int step, int member, uint activeCells, uint restingCells, bool hasRestingTypes) {
+  statsStream << step << "," << member << "," << activeCells;
+  if (hasRestingTypes) {
+    statsStream << "," << restingCells;
+  }
+  statsStream << "\n";
+}
+
+// Frees what runEnsemble set up, whether it failed part way or finished. Anything not set up yet is NULL, and the
+// exporter and publisher are only passed once they have started
+void freeEnsemble(EnsembleMember* members, uint numMembers, double* stateArrays, FrameExporter* exporter, FramePublisher* publisher) {
+  if (exporter != NULL) {
+    exporter->finish();
+    delete exporter;
+  }
+  if (publisher != NULL) {
+    publisher->finish();
+    delete publisher;
+  }
+  if (stateArrays != NULL) {
+    fftw_free(stateArrays);
+  }
+  for (int i = 0; i < numMembers; i++) {
+    freeCells(members[i].cells);
+  }
+  delete[] members;
+}
+
+int runEnsemble(const char* ensembleFileName, const char* statsFileName, int numSteps, BoundaryMode boundaryMode, const std::vector<ScriptedEdit>& script, const char* telemetryPath, ExportOptions exportOptions, const char* shmName, uint shmSlots, Pacing pacing, uint cycleHistory, bool stopOnCycle) {
+  uint numMembers;
+  EnsembleMember* members = readEnsembleFile(ensembleFileName, boundaryMode, &numMembers);
+  if (members == NULL) {
+    return 1;
+  }
+  // Everything which could fail is checked, and the outputs opened, before the FFTs are planned
+  if ((exportOptions.target != NULL || shmName != NULL) && exportOptions.member >= numMembers) {
+    std::cout << "There is no ensemble member " << exportOptions.member << " to export" << std::endl;
+    freeEnsemble(members, numMembers, NULL, NULL, NULL);
+    return 1;
+  }
+  std::ofstream statsStream(statsFileName);
+  if (!statsStream.is_open()) {
+    std::cout << "Could not open statistics file " << statsFileName << std::endl;
+    freeEnsemble(members, numMembers, NULL, NULL, NULL);
+    return 1;
+  }
+  uint numCells = members[0].cells.width * members[0].cells.height;
+  // The cells, their orientation index and their state array
+  size_t gridBytes = ((sizeof(Cell) + sizeof(uint) + sizeof(double)) * numCells + sizeof(uint) * (members[0].cells.numOrientations + 1)) * numMembers;
+  if (!checkMemoryCap(gridBytes + arenaMappedSize(NeighbourCounter::calculateArenaSize(&members[0].cells, numMembers)), "The ensemble")) {
+    freeEnsemble(members, numMembers, NULL, NULL, NULL);
+    return 1;
+  }
+  FrameExporter* exporter = NULL;
+  if (exportOptions.target != NULL) {
+    exporter = new FrameExporter();
+    if (!exporter->start(exportOptions, members[0].cells.width, members[0].cells.height)) {
+      delete exporter;
+      freeEnsemble(members, numMembers, NULL, NULL, NULL);
+      return 1;
+    }
+  }
+  FramePublisher* publisher = NULL;
+  if (shmName != NULL) {
+    publisher = new FramePublisher();
+    if (!publisher->start(shmName, shmSlots, numCells)) {
+      delete publisher;
+      freeEnsemble(members, numMembers, NULL, exporter, NULL);
+      return 1;
+    }
+  }
+  double* stateArrays = fftw_alloc_real(numCells * numMembers);
+  NeighbourCounter neighbourCounter(&members[0].cells, stateArrays, numMembers);
+  // Only filled after the FFTs are planned, as planning overwrites it
+  for (int i = 0; i < numMembers; i++) {
+    fillStateArray(members[i].cells, &stateArrays[i * numCells]);
+  }
+  std::cout << "Cells and state arrays: " << formatBytes(gridBytes) << std::endl;
+  printArenaReport(neighbourCounter.arena, "Neighbour counter");
+  EditTargets targets = findEditTargets(cellModel);
+  bool hasRestingTypes = false;
+  for (uint type = 0; type < cellModel.numTypes; type++) {
+    hasRestingTypes |= isRestingType(targets, type);
+  }
+  statsStream << (hasRestingTypes ? "step,member,active,resting" : "step,member,active") << std::endl;
+  EditQueue* editQueue = new EditQueue();
+  size_t nextScriptedEdit = 0;
+  std::vector<CycleDetector> cycleDetectors(numMembers, createCycleDetector(cycleHistory));
+  // Each member's statistics for its last cycleHistory steps, indexed by (step % cycleHistory) * numMembers + member,
+  // so that a cycle's statistics can be repeated
+  std::vector<std::pair<uint, uint>> statsHistory(stopOnCycle ? (size_t) cycleHistory * numMembers : 0);
+  StepScheduler scheduler(pacing, false);
+  // An ensemble cannot be saved, but can be paused and paced
+  TelemetryServer telemetryServer;
+  TelemetryControls telemetryControls = {&scheduler, false};
+  bool isServingTelemetry = telemetryPath != NULL && telemetryServer.start(telemetryPath, telemetryControls);
+  for (int step = 1; step <= numSteps; step++) {
+    // An edit scripted for step n is applied once n steps have been taken
+    while (!pushScriptedEdits(script, &nextScriptedEdit, step - 1, editQueue)) {
+      applyEnsembleEdits(editQueue, members, numMembers, stateArrays);
+    }
+    applyEnsembleEdits(editQueue, members, numMembers, stateArrays);
+    // Nothing quits an ensemble early, and its edits are all scripted, so only steps need waiting for
+    while (scheduler.wait() != SchedulerEvent::TakeStep) {
+    }
+    advanceEnsemble(members, numMembers, &neighbourCounter);
+    scheduler.stepTaken();
+    if (exporter != NULL) {
+      exporter->stepTaken(members[exportOptions.member].cells);
+    }
+    if (publisher != NULL) {
+      publisher->publish(members[exportOptions.member].cells, step);
+    }
+    bool isEveryMemberCycling = true;
+    uint cyclingMembers = 0;
+    uint shortestCycle = 0;
+    for (int i = 0; i < numMembers; i++) {
+      writeStatsRow(statsStream, step, i, members[i].activeCells, members[i].restingCells, hasRestingTypes);
+      if (recordStepHash(&cycleDetectors[i], step, members[i].stateHash)) {
+        std::cout << "Member " << i << " is in a cycle of length " << cycleDetectors[i].cycleLength << " as of step " << step << std::endl;
+      }
+      isEveryMemberCycling &= cycleDetectors[i].isConfirmed;
+      if (cycleDetectors[i].isConfirmed) {
+        cyclingMembers++;
+        if (shortestCycle == 0 || cycleDetectors[i].cycleLength < shortestCycle) {
+          shortestCycle = cycleDetectors[i].cycleLength;
+        }
+      }
+      if (stopOnCycle) {
+        statsHistory[(step % cycleHistory) * numMembers + i] = std::make_pair(members[i].activeCells, members[i].restingCells);
+      }
+    }
+    telemetry.cycleLength.store(shortestCycle, std::memory_order_relaxed);
+    telemetry.cyclingSimulations.store(cyclingMembers, std::memory_order_relaxed);
+    // Edits still to come could knock the members out of their cycles
+    if (stopOnCycle && isEveryMemberCycling && nextScriptedEdit == script.size() && step < numSteps) {
+      std::cout << "Every member is in a cycle, so repeating them for the remaining " << numSteps - step << " steps" << std::endl;
+      for (int laterStep = step + 1; laterStep <= numSteps; laterStep++) {
+        for (int i = 0; i < numMembers; i++) {
+          uint cycleLength = cycleDetectors[i].cycleLength;
+          // The step one whole number of cycles before laterStep which has been simulated
+          uint sourceStep = step - cycleLength + (laterStep - step - 1) % cycleLength + 1;
+          std::pair<uint, uint> stats = statsHistory[(sourceStep % cycleHistory) * numMembers + i];
+          writeStatsRow(statsStream, laterStep, i, stats.first, stats.second, hasRestingTypes);
+        }
+      }
+      break;
+    }
+  }
+  scheduler.reportOverallRate();
+  statsStream.close();
+  if (isServingTelemetry) {
+    telemetryServer.stop();
+  }
+  delete editQueue;
+  freeEnsemble(members, numMembers, stateArrays, exporter, publisher);
+  return 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include "cells.h"
+#include "edits.h"
+#include "frameexport.h"
+#include "framepublisher.h"
+#include "scheduler.h"
+
+// One of the independent simulations in an ensemble. All members share the same grid size and orientations,
+// so that they can share a single set of kernels
+struct EnsembleMember {
+  Cells cells;
+  // Statistics for the most recent step
+  uint activeCells;
+  uint restingCells;
+  // The sum of hashCell over the member's cells
+  uint64_t stateHash;
+};
+
+// Reads an ensemble definition, with one member per line in the form
+//   <dump file | blank> [pacemaker x] [pacemaker y]
+// where "blank" is a grid of inactive tissue, and the optional coordinates place a pacemaker there.
+// Returns NULL if the file is invalid, or the members do not share a grid size and orientations
+EnsembleMember* readEnsembleFile(const char* fileName, BoundaryMode boundaryMode, uint* numMembers);
+
+// Advances every member by one step, in lockstep, with neighbourCounter counting for the whole batch
+void advanceEnsemble(EnsembleMember* members, uint numMembers, NeighbourCounter* neighbourCounter);
+
+// Runs an ensemble headlessly for numSteps steps, writing each member's statistics per step to a CSV file.
+// The edits in the script are applied to every member, metrics are served on telemetryPath (if not NULL), and
+// one member is exported if exportOptions has a target (and published to shared memory as shmName, if not NULL).
+// Steps are paced as given, and can be paused over telemetry. Each member's cycles are looked for in its last cycleHistory
+// steps, and with stopOnCycle, once every member is in a cycle the rest of the statistics are filled in by repeating
+// them rather than by simulating. Returns the exit code for the program
+int runEnsemble(const char* ensembleFileName, const char* statsFileName, int numSteps, BoundaryMode boundaryMode, const std::vector<ScriptedEdit>& script, const char* telemetryPath, ExportOptions exportOptions, const char* shmName, uint shmSlots, Pacing pacing, uint cycleHistory, bool stopOnCycle);
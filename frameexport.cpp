@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "cellmodel.h"
+#include "frameexport.h"
+
+ExportOptions createDefaultExportOptions() {
+  ExportOptions options;
+  options.target = NULL;
+  options.interval = 1;
+  options.width = 0;
+  options.height = 0;
+  options.framesPerSecond = 30;
+  options.member = 0;
+  return options;
+}
+
+bool endsWith(const char* text, const char* suffix) {
+  size_t textLength = strlen(text);
+  size_t suffixLength = strlen(suffix);
+  return textLength >= suffixLength && strcmp(text + textLength - suffixLength, suffix) == 0;
+}
+
+// Whether a PNG sequence's pattern has exactly one integer conversion (such as %d or %05u) for the frame number,
+// and no other conversions apart from %%, so that it is safe to pass to snprintf
+bool isValidFramePattern(const char* pattern) {
+  uint numConversions = 0;
+  for (const char* c = pattern; *c != '\0'; c++) {
+    if (*c != '%') {
+      continue;
+    }
+    c++;
+    if (*c == '%') {
+      continue;
+    }
+    while (*c >= '0' && *c <= '9') {
+      c++;
+    }
+    if (*c != 'd' && *c != 'u' && *c != 'i') {
+      return false;
+    }
+    numConversions++;
+  }
+  return numConversions == 1;
+}
+
+bool FrameExporter::start(ExportOptions options, uint gridWidth, uint gridHeight) {
+  this->options = options;
+  if (this->options.width == 0 || this->options.height == 0) {
+    this->options.width = gridWidth;
+    this->options.height = gridHeight;
+  }
+  output = NULL;
+  isPipe = options.target[0] == '|';
+  if (isPipe) {
+    format = ExportFormat::Y4M;
+    output = popen(options.target + 1, "w");
+  }
+  else if (strchr(options.target, '%') != NULL) {
+    if (!isValidFramePattern(options.target)) {
+      std::cout << "The export pattern " << options.target << " must have exactly one %d (such as frames/%05d.png), and no other % apart from %%" << std::endl;
+      return false;
+    }
+    format = ExportFormat::PNGSequence;
+  }
+  else {
+    format = endsWith(options.target, ".y4m") ? ExportFormat::Y4M : ExportFormat::RawRGB;
+    output = fopen(options.target, "wb");
+  }
+  if (format != ExportFormat::PNGSequence && output == NULL) {
+    std::cout << "Could not open " << options.target << " for exporting" << std::endl;
+    return false;
+  }
+  if (format == ExportFormat::Y4M) {
+    fprintf(output, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", this->options.width, this->options.height, options.framesPerSecond);
+  }
+  // The same colours as the renderer
+  for (int i = 0; i < MAX_CELL_TYPES * MAX_CELL_STATES; i++) {
+    uint32_t colour = cellColour(i);
+    palette[i][0] = (colour >> 16) & 0xFF;
+    palette[i][1] = (colour >> 8) & 0xFF;
+    palette[i][2] = colour & 0xFF;
+    if (format == ExportFormat::Y4M) {
+      // Converted to BT.601 (in the limited range) up front. The conversion is linear, so averaging the converted
+      // colours when downscaling gives the same result as converting the averages
+      int r = palette[i][0];
+      int g = palette[i][1];
+      int b = palette[i][2];
+      palette[i][0] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+      palette[i][1] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+      palette[i][2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+  }
+  stepsTaken = 0;
+  framesCaptured = 0;
+  nextFrameToWrite = 0;
+  isFinishing = false;
+  for (int i = 0; i < EXPORT_THREADS; i++) {
+    threads[i] = std::thread(&FrameExporter::encodeFrames, this);
+  }
+  std::cout << "Exporting every " << options.interval << " steps to " << options.target << " at " << this->options.width << "x" << this->options.height << std::endl;
+  return true;
+}
+
+void FrameExporter::stepTaken(Cells cells) {
+  CapturedFrame frame;
+  if (captureStep(cells, &frame)) {
+    submitFrame(std::move(frame));
+  }
+}
+
+bool FrameExporter::captureStep(Cells cells, CapturedFrame* frame) {
+  stepsTaken++;
+  if (stepsTaken % options.interval != 0) {
+    return false;
+  }
+  frame->index = framesCaptured;
+  frame->width = cells.width;
+  frame->height = cells.height;
+  frame->cells.resize(cells.width * cells.height);
+  for (int i = 0; i < cells.width * cells.height; i++) {
+    frame->cells[i] = (cells.cells[i].type << 4) | cells.cells[i].state;
+  }
+  framesCaptured++;
+  return true;
+}
+
+void FrameExporter::submitFrame(CapturedFrame frame) {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  // If the encoders fall behind, the simulation waits for them rather than frames being dropped
+  queueChanged.wait(lock, [this] { return queue.size() < EXPORT_QUEUE_SIZE; });
+  queue.push_back(std::move(frame));
+  lock.unlock();
+  queueChanged.notify_all();
+}
+
+void FrameExporter::finish() {
+  std::unique_lock<std::mutex> lock(queueMutex);
+  isFinishing = true;
+  lock.unlock();
+  queueChanged.notify_all();
+  for (int i = 0; i < EXPORT_THREADS; i++) {
+    threads[i].join();
+  }
+  if (output != NULL) {
+    if (isPipe) {
+      pclose(output);
+    }
+    else {
+      fclose(output);
+    }
+  }
+  std::cout << "Exported " << framesCaptured << " frames to " << options.target << std::endl;
+}
+
+void FrameExporter::encodeFrames() {
+  std::vector<uint8_t> pixels;
+  while (true) {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    queueChanged.wait(lock, [this] { return !queue.empty() || isFinishing; });
+    if (queue.empty()) {
+      return;
+    }
+    CapturedFrame frame = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+    queueChanged.notify_all();
+    colourFrame(frame, &pixels);
+    writeFrame(frame.index, pixels);
+  }
+}
+
+void FrameExporter::colourFrame(const CapturedFrame& frame, std::vector<uint8_t>* pixels) {
+  uint width = options.width;
+  uint height = options.height;
+  pixels->resize(width * height * 3);
+  // Y4M is planar, while the other formats interleave the channels
+  size_t channelStride = format == ExportFormat::Y4M ? width * height : 1;
+  size_t pixelStride = format == ExportFormat::Y4M ? 1 : 3;
+  uint8_t* output = pixels->data();
+  if (frame.width == width && frame.height == height) {
+    for (size_t i = 0; i < width * height; i++) {
+      const uint8_t* colour = palette[frame.cells[i]];
+      output[i * pixelStride] = colour[0];
+      output[i * pixelStride + channelStride] = colour[1];
+      output[i * pixelStride + 2 * channelStride] = colour[2];
+    }
+    return;
+  }
+  for (uint y = 0; y < height; y++) {
+    // Each output pixel is the average of the cells it covers, or the nearest cell if it covers less than one
+    uint firstRow = (y * frame.height) / height;
+    uint lastRow = std::max(((y + 1) * frame.height) / height, firstRow + 1);
+    for (uint x = 0; x < width; x++) {
+      uint firstColumn = (x * frame.width) / width;
+      uint lastColumn = std::max(((x + 1) * frame.width) / width, firstColumn + 1);
+      uint total[3] = {0, 0, 0};
+      for (uint i = firstRow; i < lastRow; i++) {
+        for (uint j = firstColumn; j < lastColumn; j++) {
+          const uint8_t* colour = palette[frame.cells[i * frame.width + j]];
+          total[0] += colour[0];
+          total[1] += colour[1];
+          total[2] += colour[2];
+        }
+      }
+      uint numCells = (lastRow - firstRow) * (lastColumn - firstColumn);
+      size_t pixel = (y * width + x) * pixelStride;
+      output[pixel] = total[0] / numCells;
+      output[pixel + channelStride] = total[1] / numCells;
+      output[pixel + 2 * channelStride] = total[2] / numCells;
+    }
+  }
+}
+
+struct CRC32Table {
+  uint32_t entries[256];
+  CRC32Table() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t value = i;
+      for (int j = 0; j < 8; j++) {
+        value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+      }
+      entries[i] = value;
+    }
+  }
+};
+
+uint32_t updateCRC32(uint32_t crc, const uint8_t* data, size_t length) {
+  // Built on first use, which is thread safe for a local static
+  static const CRC32Table table;
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+void appendBigEndian(std::vector<uint8_t>* data, uint32_t value) {
+  data->push_back(value >> 24);
+  data->push_back(value >> 16);
+  data->push_back(value >> 8);
+  data->push_back(value);
+}
+
+void appendPNGChunk(std::vector<uint8_t>* png, const char* type, const std::vector<uint8_t>& contents) {
+  appendBigEndian(png, contents.size());
+  size_t typeStart = png->size();
+  png->insert(png->end(), type, type + 4);
+  png->insert(png->end(), contents.begin(), contents.end());
+  appendBigEndian(png, updateCRC32(0, &(*png)[typeStart], png->size() - typeStart));
+}
+
+// An RGB PNG, with the image data stored without compression (which keeps this fast and dependency free)
+std::vector<uint8_t> encodePNG(const std::vector<uint8_t>& pixels, uint width, uint height) {
+  const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  std::vector<uint8_t> png(signature, signature + 8);
+  std::vector<uint8_t> header;
+  appendBigEndian(&header, width);
+  appendBigEndian(&header, height);
+  // 8 bits per channel, RGB, with the standard compression, filtering and no interlacing
+  const uint8_t format[5] = {8, 2, 0, 0, 0};
+  header.insert(header.end(), format, format + 5);
+  appendPNGChunk(&png, "IHDR", header);
+  // Each row starts with its filter type, which is 0 (none)
+  std::vector<uint8_t> rows;
+  rows.reserve((width * 3 + 1) * height);
+  for (uint y = 0; y < height; y++) {
+    rows.push_back(0);
+    rows.insert(rows.end(), pixels.begin() + y * width * 3, pixels.begin() + (y + 1) * width * 3);
+  }
+  // A zlib stream of stored deflate blocks, which can each hold up to 65535 bytes
+  std::vector<uint8_t> data = {0x78, 0x01};
+  for (size_t start = 0; start < rows.size() || start == 0; start += 65535) {
+    uint16_t length = std::min(rows.size() - start, (size_t) 65535);
+    data.push_back(start + length >= rows.size());
+    data.push_back(length & 0xFF);
+    data.push_back(length >> 8);
+    data.push_back(~length & 0xFF);
+    data.push_back((~length >> 8) & 0xFF);
+    data.insert(data.end(), rows.begin() + start, rows.begin() + start + length);
+  }
+  uint32_t a = 1;
+  uint32_t b = 0;
+  for (uint8_t byte : rows) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  appendBigEndian(&data, (b << 16) | a);
+  appendPNGChunk(&png, "IDAT", data);
+  appendPNGChunk(&png, "IEND", std::vector<uint8_t>());
+  return png;
+}
+
+void FrameExporter::writeFrame(uint index, const std::vector<uint8_t>& pixels) {
+  uint width = options.width;
+  uint height = options.height;
+  if (format == ExportFormat::PNGSequence) {
+    // Each image is its own file, so there is no need to wait for the frames before it
+    std::vector<uint8_t> encoded = encodePNG(pixels, width, height);
+    char fileName[4096];
+    snprintf(fileName, sizeof(fileName), options.target, index);
+    FILE* file = fopen(fileName, "wb");
+    if (file == NULL) {
+      std::cout << "Could not write frame " << fileName << std::endl;
+      return;
+    }
+    fwrite(encoded.data(), 1, encoded.size(), file);
+    fclose(file);
+    return;
+  }
+  std::unique_lock<std::mutex> lock(writeMutex);
+  frameWritten.wait(lock, [this, index] { return nextFrameToWrite == index; });
+  if (format == ExportFormat::Y4M) {
+    fputs("FRAME\n", output);
+  }
+  fwrite(pixels.data(), 1, pixels.size(), output);
+  nextFrameToWrite++;
+  lock.unlock();
+  frameWritten.notify_all();
+}
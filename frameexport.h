@@ -0,0 +1,86 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cells.h"
+
+// The number of threads which colour, scale and encode frames
+#define EXPORT_THREADS 2
+// How many captured frames may be waiting to be encoded before capturing blocks
+#define EXPORT_QUEUE_SIZE 8
+
+enum ExportFormat {
+  // YUV4MPEG2 (4:4:4), which ffmpeg and most players read directly
+  Y4M,
+  // Packed 8-bit RGB frames, one after another, with no header
+  RawRGB,
+  // A numbered sequence of (uncompressed) PNG files
+  PNGSequence
+};
+
+struct ExportOptions {
+  // A file name, a printf pattern such as frames/%05d.png for a PNG sequence, or |command to pipe Y4M to a command
+  const char* target;
+  // Every Nth step is exported
+  uint interval;
+  // The size of the frames, or 0 to use the size of the grid
+  uint width;
+  uint height;
+  uint framesPerSecond;
+  // Which member of an ensemble is exported
+  uint member;
+};
+
+ExportOptions createDefaultExportOptions();
+
+// A copy of the cells' types and states, taken between steps
+struct CapturedFrame {
+  uint index;
+  uint width;
+  uint height;
+  // (type << 4) | state for each cell, the same packing that the cell model's tables use
+  std::vector<uint8_t> cells;
+};
+
+// Turns steps of the simulation into a video or a sequence of images. The simulation thread only copies the
+// cells, while the colouring, scaling, encoding and writing happen on background threads
+class FrameExporter {
+  public:
+    // Returns false if the target could not be opened
+    bool start(ExportOptions options, uint gridWidth, uint gridHeight);
+    // Called after each step, exporting it if it is one of every options.interval steps
+    void stepTaken(Cells cells);
+    // The two halves of stepTaken, so that the cells can be copied while they are locked, but the wait for the
+    // encoders to catch up happens after they are unlocked. Returns false if this step is not exported
+    bool captureStep(Cells cells, CapturedFrame* frame);
+    // Queues a captured frame to be encoded, blocking while EXPORT_QUEUE_SIZE frames are already waiting
+    void submitFrame(CapturedFrame frame);
+    // Waits for every captured frame to be written, then closes the target
+    void finish();
+  private:
+    ExportOptions options;
+    ExportFormat format;
+    FILE* output;
+    bool isPipe;
+    uint stepsTaken;
+    uint framesCaptured;
+    // The colour of each packed type and state, as RGB, or YUV for Y4M
+    uint8_t palette[MAX_CELL_TYPES * MAX_CELL_STATES][3];
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque<CapturedFrame> queue;
+    bool isFinishing;
+    // Frames are encoded in parallel, but must be written in order
+    std::mutex writeMutex;
+    std::condition_variable frameWritten;
+    uint nextFrameToWrite;
+    std::thread threads[EXPORT_THREADS];
+    void encodeFrames();
+    void colourFrame(const CapturedFrame& frame, std::vector<uint8_t>* pixels);
+    void writeFrame(uint index, const std::vector<uint8_t>& pixels);
+};
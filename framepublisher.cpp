@@ -0,0 +1,69 @@
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "framepublisher.h"
+
+bool FramePublisher::start(const char* name, uint numSlots, uint64_t maxCells) {
+  // POSIX shared memory names start with a slash
+  this->name = name[0] == '/' ? name : std::string("/") + name;
+  hasWarnedTooLarge = false;
+  size = frameRingSize(numSlots, maxCells);
+  int fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cout << "Could not create shared memory " << this->name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  void* base = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    std::cout << "Could not map shared memory " << this->name << ": " << strerror(errno) << std::endl;
+    shm_unlink(this->name.c_str());
+    return false;
+  }
+  // The new pages are zeroed, so every slot's sequence starts at 0 and nothing has been published
+  header = (FrameRingHeader*) base;
+  header->version = FRAME_RING_VERSION;
+  header->numSlots = numSlots;
+  header->slotBytes = frameRingAlign(sizeof(FrameSlotHeader) + maxCells);
+  header->maxCells = maxCells;
+  header->framesPublished.store(0, std::memory_order_relaxed);
+  header->magic.store(FRAME_RING_MAGIC, std::memory_order_release);
+  std::cout << "Publishing frames to shared memory " << this->name << " (" << numSlots << " slots, " << formatBytes(size) << ")" << std::endl;
+  return true;
+}
+
+void FramePublisher::publish(Cells cells, uint64_t step) {
+  uint64_t numCells = (uint64_t) cells.width * cells.height;
+  if (numCells > header->maxCells) {
+    if (!hasWarnedTooLarge) {
+      std::cout << "The grid is too large for the shared memory frames, so is not being published" << std::endl;
+      hasWarnedTooLarge = true;
+    }
+    return;
+  }
+  uint64_t framesPublished = header->framesPublished.load(std::memory_order_relaxed);
+  FrameSlotHeader* slot = frameRingSlot(header, framesPublished % header->numSlots);
+  uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+  // Keeps the writes below from becoming visible before the sequence is odd
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->step = step;
+  slot->width = cells.width;
+  slot->height = cells.height;
+  uint8_t* packedCells = (uint8_t*) (slot + 1);
+  for (uint64_t i = 0; i < numCells; i++) {
+    packedCells[i] = (cells.cells[i].type << 4) | cells.cells[i].state;
+  }
+  slot->sequence.store(sequence + 2, std::memory_order_release);
+  header->framesPublished.store(framesPublished + 1, std::memory_order_release);
+}
+
+void FramePublisher::finish() {
+  munmap(header, size);
+  shm_unlink(name.c_str());
+}
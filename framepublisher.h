@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include "cells.h"
+#include "framering.h"
+
+// Publishes each step to a frame ring in POSIX shared memory (see framering.h), for other processes to read while
+// the simulation runs. Publishing only copies the cells into the next slot, and never waits for readers
+class FramePublisher {
+  public:
+    // Creates the ring under the given name, with room in each slot for maxCells cells. Returns false if it could
+    // not be created
+    bool start(const char* name, uint numSlots, uint64_t maxCells);
+    // Called after each step, with the number of steps taken so far
+    void publish(Cells cells, uint64_t step);
+    // Unmaps and removes the ring. Readers which still have it mapped can keep reading the last frames
+    void finish();
+  private:
+    std::string name;
+    FrameRingHeader* header;
+    size_t size;
+    // Grids larger than a slot (such as a larger dump being loaded) are not published
+    bool hasWarnedTooLarge;
+};
@@ -0,0 +1,53 @@
+// An example of reading the frames which the simulation publishes with --shm=name. It prints a summary of each
+// new frame it sees, reading the latest frame in place without copying it.
+// Usage: framereader name [poll interval in ms]
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include "framering.cpp"
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " name [poll interval in ms]" << std::endl;
+    return 1;
+  }
+  std::string name = argv[1][0] == '/' ? argv[1] : std::string("/") + argv[1];
+  int interval = argc > 2 ? atoi(argv[2]) : 10;
+  FrameRingReader reader;
+  if (!openFrameRing(name.c_str(), &reader)) {
+    return 1;
+  }
+  uint64_t lastStep = 0;
+  uint64_t framesSeen = 0;
+  uint64_t tornReads = 0;
+  while (true) {
+    FrameView view;
+    if (beginFrameRead(&reader, &view) && (framesSeen == 0 || view.step != lastStep)) {
+      // Count the cells of each type, and how many have a non-zero state, straight from the shared memory
+      uint64_t typeCounts[16] = {0};
+      uint64_t nonZeroStates = 0;
+      for (uint64_t i = 0; i < (uint64_t) view.width * view.height; i++) {
+        typeCounts[view.cells[i] >> 4]++;
+        nonZeroStates += (view.cells[i] & 15) != 0;
+      }
+      // If the simulation lapped the ring while this frame was being read, the counts are thrown away
+      if (isFrameStillValid(&reader, view)) {
+        std::cout << "Step " << view.step << " (" << view.width << "x" << view.height << "): " << nonZeroStates << " cells with a non-zero state, types";
+        for (int i = 0; i < 16; i++) {
+          if (typeCounts[i] > 0) {
+            std::cout << " " << i << "=" << typeCounts[i];
+          }
+        }
+        std::cout << std::endl;
+        lastStep = view.step;
+        framesSeen++;
+      }
+      else {
+        tornReads++;
+        std::cout << "Frame at step " << view.step << " was overwritten while reading it (" << tornReads << " so far)" << std::endl;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+  }
+}
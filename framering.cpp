@@ -0,0 +1,100 @@
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "framering.h"
+
+size_t frameRingAlign(size_t bytes) {
+  return (bytes + FRAME_RING_ALIGNMENT - 1) & ~((size_t) FRAME_RING_ALIGNMENT - 1);
+}
+
+size_t frameRingSize(uint32_t numSlots, uint64_t maxCells) {
+  return sizeof(FrameRingHeader) + numSlots * frameRingAlign(sizeof(FrameSlotHeader) + maxCells);
+}
+
+FrameSlotHeader* frameRingSlot(FrameRingHeader* header, uint32_t slot) {
+  return (FrameSlotHeader*) ((uint8_t*) header + sizeof(FrameRingHeader) + slot * header->slotBytes);
+}
+
+bool openFrameRing(const char* name, FrameRingReader* reader) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    std::cout << "Could not open shared memory " << name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size < (off_t) sizeof(FrameRingHeader)) {
+    std::cout << "Shared memory " << name << " is too small to be a frame ring" << std::endl;
+    close(fd);
+    return false;
+  }
+  void* base = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // The mapping stays valid once the descriptor is closed
+  close(fd);
+  if (base == MAP_FAILED) {
+    std::cout << "Could not map shared memory " << name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  reader->header = (FrameRingHeader*) base;
+  reader->size = status.st_size;
+  if (reader->header->magic.load(std::memory_order_acquire) != FRAME_RING_MAGIC || reader->header->version != FRAME_RING_VERSION ||
+      frameRingSize(reader->header->numSlots, reader->header->maxCells) > reader->size) {
+    std::cout << "Shared memory " << name << " is not a frame ring, or is from a different version" << std::endl;
+    closeFrameRing(reader);
+    return false;
+  }
+  return true;
+}
+
+void closeFrameRing(FrameRingReader* reader) {
+  munmap(reader->header, reader->size);
+  reader->header = NULL;
+}
+
+bool beginFrameRead(FrameRingReader* reader, FrameView* view) {
+  uint64_t framesPublished = reader->header->framesPublished.load(std::memory_order_acquire);
+  if (framesPublished == 0) {
+    return false;
+  }
+  view->slot = (framesPublished - 1) % reader->header->numSlots;
+  FrameSlotHeader* slot = frameRingSlot(reader->header, view->slot);
+  view->sequence = slot->sequence.load(std::memory_order_acquire);
+  if (view->sequence % 2 == 1) {
+    return false;
+  }
+  view->step = slot->step;
+  view->width = slot->width;
+  view->height = slot->height;
+  view->cells = (const uint8_t*) (slot + 1);
+  // A torn read of the size could point past the slot, so it is clamped until the frame is validated
+  if ((uint64_t) view->width * view->height > reader->header->maxCells) {
+    view->width = 0;
+    view->height = 0;
+  }
+  return true;
+}
+
+bool isFrameStillValid(FrameRingReader* reader, const FrameView& view) {
+  // Keeps the reads of the cells from being moved after the sequence is checked
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return frameRingSlot(reader->header, view.slot)->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
+
+bool copyLatestFrame(FrameRingReader* reader, FrameView* view, std::vector<uint8_t>* cells) {
+  while (true) {
+    if (!beginFrameRead(reader, view)) {
+      if (reader->header->framesPublished.load(std::memory_order_acquire) == 0) {
+        return false;
+      }
+      // The latest frame is being written, which will not take long
+      continue;
+    }
+    cells->assign(view->cells, view->cells + (size_t) view->width * view->height);
+    if (isFrameStillValid(reader, *view)) {
+      view->cells = cells->data();
+      return true;
+    }
+  }
+}
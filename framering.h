@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The layout of the shared memory which the simulation publishes its steps to, and a reader for it. This header
+// does not depend on the rest of the simulation, so that other programs can include it (see framereader.cpp).
+//
+// The shared memory starts with a FrameRingHeader, followed by numSlots slots of slotBytes each. Each slot is a
+// FrameSlotHeader followed by the cells of one step, one byte per cell as (type << 4) | state, row by row. Steps are
+// written to the slots in turn, so a reader has numSlots - 1 more steps to read a frame before it is overwritten
+#define FRAME_RING_MAGIC 0x474e495246454d41ULL
+#define FRAME_RING_VERSION 1
+// Headers are padded to a cache line, so that the slots' cells are aligned and do not share lines with the headers
+#define FRAME_RING_ALIGNMENT 64
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The frame ring needs lock-free 64-bit atomics to be shared between processes");
+
+struct alignas(FRAME_RING_ALIGNMENT) FrameRingHeader {
+  // Only set once the rest of the ring is initialized
+  std::atomic<uint64_t> magic;
+  uint32_t version;
+  uint32_t numSlots;
+  // The size of a slot, including its header
+  uint64_t slotBytes;
+  // The most cells a slot can hold
+  uint64_t maxCells;
+  // How many frames have been published, so the latest one is in slot (framesPublished - 1) % numSlots
+  std::atomic<uint64_t> framesPublished;
+};
+
+struct alignas(FRAME_RING_ALIGNMENT) FrameSlotHeader {
+  // A seqlock, which is odd while the slot is being written. A frame was read consistently if the sequence was even
+  // before reading it, and is unchanged after
+  std::atomic<uint64_t> sequence;
+  // The number of steps which had been taken when the frame was published
+  uint64_t step;
+  uint32_t width;
+  uint32_t height;
+};
+
+// Rounds up to a multiple of FRAME_RING_ALIGNMENT
+size_t frameRingAlign(size_t bytes);
+
+// The total size of a ring with the given number of slots and cells per slot
+size_t frameRingSize(uint32_t numSlots, uint64_t maxCells);
+
+// The header of the given slot
+FrameSlotHeader* frameRingSlot(FrameRingHeader* header, uint32_t slot);
+
+struct FrameRingReader {
+  FrameRingHeader* header;
+  size_t size;
+};
+
+// A frame being read in place. The cells must not be trusted until isFrameStillValid has confirmed that the
+// frame was not overwritten while it was being read
+struct FrameView {
+  uint64_t step;
+  uint32_t width;
+  uint32_t height;
+  const uint8_t* cells;
+  uint32_t slot;
+  uint64_t sequence;
+};
+
+// Maps the ring published under the given name (as passed to --shm) read-only. Returns false if it does not exist
+// or is not a frame ring
+bool openFrameRing(const char* name, FrameRingReader* reader);
+
+void closeFrameRing(FrameRingReader* reader);
+
+// Starts reading the latest frame in place, with no copying. Returns false if nothing has been published yet, or
+// the latest frame is being written
+bool beginFrameRead(FrameRingReader* reader, FrameView* view);
+
+// Whether the frame was unchanged for the whole time since beginFrameRead
+bool isFrameStillValid(FrameRingReader* reader, const FrameView& view);
+
+// Copies the latest frame's cells, retrying until the copy is consistent. Returns false if nothing has been published
+bool copyLatestFrame(FrameRingReader* reader, FrameView* view, std::vector<uint8_t>* cells);
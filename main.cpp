@@ -5,6 +5,18 @@ Copyright (C) 2025 Eshe Hinchliffe
 */
 
 #include "cells.cpp"
+#include "cellmodel.cpp"
+#include "arena.cpp"
+#include "placement.cpp"
+#include "tiles.h"
+#include "ensemble.cpp"
+#include "edits.cpp"
+#include "scheduler.cpp"
+#include "telemetry.cpp"
+#include "frameexport.cpp"
+#include "cycles.cpp"
+#include "framering.cpp"
+#include "framepublisher.cpp"
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_keycode.h>
@@ -26,6 +38,8 @@ SDL_Renderer* renderer = NULL;
 
 
 std::mutex mu;
+// Bumped (under mu) whenever the grid is replaced, so that the simulation thread forgets the steps before it
+uint gridGeneration = 0;
 
 // Cyclically shifts a convolution to expand it, i.e. for padding reasons
 void shiftConvolution(double* originalConvolution, double* shiftedConvolution, int convWidth, int dataHeight, int dataLength) {
@@ -55,64 +69,260 @@ void shiftConvolution(double* originalConvolution, double* shiftedConvolution, i
   }
 }
 
-// Updates the cells in a seperate thread, so as to keep the render updates fast
-void updateCells(Cells* cells, bool* quit, bool* paused, bool* step, int* frameTime, double* stateArray, NeighbourCounter* neighbourCounter) {
-  long int startTime;
-  long int elapsedTime;
-  while (!(*quit)) {
-    startTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+// The memory a grid needs, other than for rendering it. Each cell also has an entry in the orientation index
+size_t calculateSimulationMemory(Cells* cells) {
+  return (sizeof(Cell) + sizeof(uint) + sizeof(double)) * cells->width * cells->height + sizeof(uint) * (cells->numOrientations + 1) +
+    arenaMappedSize(NeighbourCounter::calculateArenaSize(cells, 1));
+}
+
+// Queues an edit from the UI, which is dropped if the simulation thread has fallen that far behind, and wakes the
+// simulation thread to apply it
+void pushEdit(EditQueue* editQueue, StepScheduler* scheduler, EditCommand edit) {
+  if (!editQueue->push(edit)) {
+    std::cout << "Too many edits queued, ignoring this one" << std::endl;
+    return;
+  }
+  scheduler->wake();
+}
+
+// Applies the queued edits, along with any scripted ones which are due by the given step.
+// Checkpoints asked for over telemetry are also saved here, as this is only called between steps
+void applyEdits(Cells* cells, NeighbourCounter* neighbourCounter, TileActivity* tiles, EditQueue* editQueue, std::vector<ScriptedEdit>* script, size_t* nextScriptedEdit, uint step) {
+  auto start = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(mu);
+  uint numEdits = 0;
+  // If the script fills the queue, it is emptied before pushing the rest
+  while (!pushScriptedEdits(*script, nextScriptedEdit, step, editQueue)) {
+    numEdits += applyQueuedEdits(editQueue, cells, neighbourCounter->stateArray, tiles);
+  }
+  numEdits += applyQueuedEdits(editQueue, cells, neighbourCounter->stateArray, tiles);
+  if (telemetry.checkpointRequested.exchange(false)) {
+    saveCellsToFile(*cells, "cells.dmp");
+    std::cout << "Saved checkpoint at step " << step << std::endl;
+  }
+  lock.unlock();
+  // This is also called before steps with no edits due, so only the times edits were actually made are recorded
+  if (numEdits > 0) {
+    recordStage(TelemetryStage::EditStage, start);
+  }
+}
+
+// Checks whether the step just taken has returned the grid to an earlier one, and reports any cycle found
+void detectCycle(CycleDetector* detector, TileActivity* tiles, uint step) {
+  uint previousLength = detector->cycleLength;
+  bool wasConfirmed = detector->isConfirmed;
+  if (recordStepHash(detector, step, tiles->gridHash())) {
+    std::cout << "Confirmed a cycle of length " << detector->cycleLength << " at step " << step << std::endl;
+  }
+  else if (detector->cycleLength != 0 && previousLength == 0) {
+    std::cout << "Step " << step << " repeats step " << step - detector->cycleLength << ", checking for a cycle" << std::endl;
+  }
+  else if (wasConfirmed && !detector->isConfirmed) {
+    std::cout << "Left the cycle of length " << previousLength << " at step " << step << std::endl;
+  }
+  telemetry.cycleLength.store(detector->isConfirmed ? detector->cycleLength : 0, std::memory_order_relaxed);
+  telemetry.cyclingSimulations.store(detector->isConfirmed, std::memory_order_relaxed);
+}
+
+// Updates the cells in a seperate thread, so as to keep the render updates fast.
+// This is the only thread which changes the cells, with edits from the UI (and the script) queued up for it.
+// The scheduler decides when each step is taken, and wakes this thread as soon as there are edits to apply
+void updateCells(Cells* cells, StepScheduler* scheduler, NeighbourCounter* neighbourCounter, TileActivity* tiles, EditQueue* editQueue, std::vector<ScriptedEdit>* script, FrameExporter* exporter, FramePublisher* publisher, uint cycleHistory) {
+  uint currentStep = 0;
+  CycleDetector cycleDetector = createCycleDetector(cycleHistory);
+  uint detectorGeneration = gridGeneration;
+  size_t nextScriptedEdit = 0;
+  pinFFTThread();
+  while (true) {
+    SchedulerEvent event = scheduler->wait();
+    if (event == SchedulerEvent::Quit) {
+      break;
+    }
+    applyEdits(cells, neighbourCounter, tiles, editQueue, script, &nextScriptedEdit, currentStep);
+    if (event != SchedulerEvent::TakeStep) {
+      continue;
+    }
     // Lock the mutex, as data is being written
     std::unique_lock<std::mutex> lock(mu);
-    advanceCells(cells, neighbourCounter);
+    advanceCells(cells, neighbourCounter, tiles);
+    currentStep++;
+    // A loaded grid's steps would otherwise match the hashes of the steps before it was saved
+    if (detectorGeneration != gridGeneration) {
+      cycleDetector = createCycleDetector(cycleHistory);
+      detectorGeneration = gridGeneration;
+    }
+    detectCycle(&cycleDetector, tiles, currentStep);
+    CapturedFrame frame;
+    bool isExporting = exporter != NULL && exporter->captureStep(*cells, &frame);
+    if (publisher != NULL) {
+      publisher->publish(*cells, currentStep);
+    }
     lock.unlock();
-    elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() - startTime;
-    if (elapsedTime <= *frameTime) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(*frameTime - elapsedTime));
-    }
-    std::this_thread::sleep_for(std::chrono::milliseconds(25));
-    while (*paused && !(*quit)) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(250));
-      if (*step) {
-        *step = false;
-        std::unique_lock<std::mutex> lock(mu);
-        advanceCells(cells, neighbourCounter);
-        lock.unlock();
-      }
+    // Waiting for the encoders must not hold up the rendering (or edits from the UI)
+    if (isExporting) {
+      exporter->submitFrame(std::move(frame));
     }
+    scheduler->stepTaken();
   }
+  scheduler->reportOverallRate();
 }
 
 
 int main (int argc, char *argv[]) {
-  if (SDL_Init(SDL_INIT_VIDEO) < 0 || TTF_Init() < 0) {
-    return 0;
-  }
-  // Declare the 2D plane of cells
-  Cells cells;
-  cells.width = SIZE;
-  cells.height = SIZE;
-  cells.cells = new Cell[cells.height * cells.width];
-  cells.numOrientations = 1;
-  cells.orientations = new Orientation[1];
-  cells.orientations[0].xDir = 1.0;
-  cells.orientations[0].yDir = 0.0;
-  cells.orientations[0].cellCount = cells.height * cells.width * 0.5;
-  // Initialize all cells to be inactive normal tissue
-  for (int i = 0; i < cells.height; i++) {
-    for (int j = 0; j < cells.width; j++) {
-      Cell newCell;
-      newCell.type = CellType::Tissue;
-      newCell.state = 0;
-      if (j < cells.width / 2) {
-        newCell.orientationIndex = 0;
-        cells.orientations[0].cells.push_front(&newCell);
+  // Use the best kernels this CPU supports, unless overridden with --simd=scalar|avx2|avx512
+  SimdLevel simdLevel = detectSimdLevel();
+  BoundaryMode boundaryMode = BoundaryMode::Periodic;
+  const char* ensembleFileName = NULL;
+  const char* statsFileName = "ensemble_stats.csv";
+  int numSteps = 1000;
+  int numFFTThreads = 1;
+  bool reportNuma = false;
+  std::vector<ScriptedEdit> script;
+  const char* telemetryPath = NULL;
+  ExportOptions exportOptions = createDefaultExportOptions();
+  uint cycleHistory = 10000;
+  // The interactive mode takes 2 steps per second by default, and ensembles go as fast as possible
+  Pacing pacing = createPacing(PacingMode::FixedRate, 2);
+  bool isPacingSet = false;
+  const char* shmName = NULL;
+  uint shmSlots = 4;
+  bool stopOnCycle = false;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--simd=", 7) == 0) {
+      SimdLevel requestedLevel;
+      if (!parseSimdLevel(argv[i] + 7, &requestedLevel)) {
+        std::cout << "Unknown SIMD level: " << argv[i] + 7 << std::endl;
+        return 1;
+      }
+      if (requestedLevel > simdLevel) {
+        std::cout << "This CPU does not support " << simdLevelToString(requestedLevel) << std::endl;
+        return 1;
+      }
+      simdLevel = requestedLevel;
+    }
+    else if (strncmp(argv[i], "--model=", 8) == 0) {
+      if (!readCellModelFromFile(argv[i] + 8, &cellModel)) {
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], "--ensemble=", 11) == 0) {
+      ensembleFileName = argv[i] + 11;
+    }
+    else if (strncmp(argv[i], "--stats=", 8) == 0) {
+      statsFileName = argv[i] + 8;
+    }
+    else if (strncmp(argv[i], "--telemetry=", 12) == 0) {
+      telemetryPath = argv[i] + 12;
+    }
+    else if (strncmp(argv[i], "--export=", 9) == 0) {
+      exportOptions.target = argv[i] + 9;
+    }
+    else if (strncmp(argv[i], "--export-every=", 15) == 0) {
+      exportOptions.interval = std::max(atoi(argv[i] + 15), 1);
+    }
+    else if (strncmp(argv[i], "--export-size=", 14) == 0) {
+      if (sscanf(argv[i] + 14, "%ux%u", &exportOptions.width, &exportOptions.height) != 2) {
+        std::cout << "The export size must be given as WIDTHxHEIGHT" << std::endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], "--export-fps=", 13) == 0) {
+      exportOptions.framesPerSecond = std::max(atoi(argv[i] + 13), 1);
+    }
+    else if (strncmp(argv[i], "--export-member=", 16) == 0) {
+      exportOptions.member = atoi(argv[i] + 16);
+    }
+    else if (strncmp(argv[i], "--script=", 9) == 0) {
+      if (!readStimulusScript(argv[i] + 9, &script)) {
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], "--pace=", 7) == 0) {
+      if (!parsePacing(argv[i] + 7, &pacing)) {
+        std::cout << "Unknown pacing: " << argv[i] + 7 << std::endl;
+        return 1;
+      }
+      isPacingSet = true;
+    }
+    else if (strncmp(argv[i], "--step-duration=", 16) == 0) {
+      pacing.simulatedMsPerStep = atof(argv[i] + 16);
+      if (pacing.simulatedMsPerStep <= 0) {
+        std::cout << "The step duration must be a positive number of milliseconds" << std::endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], "--shm=", 6) == 0) {
+      shmName = argv[i] + 6;
+    }
+    else if (strncmp(argv[i], "--shm-slots=", 12) == 0) {
+      shmSlots = std::max(atoi(argv[i] + 12), 2);
+    }
+    else if (strncmp(argv[i], "--cycle-history=", 16) == 0) {
+      cycleHistory = std::max(atoi(argv[i] + 16), 1);
+    }
+    else if (strcmp(argv[i], "--stop-on-cycle") == 0) {
+      stopOnCycle = true;
+    }
+    else if (strncmp(argv[i], "--steps=", 8) == 0) {
+      numSteps = atoi(argv[i] + 8);
+    }
+    else if (strncmp(argv[i], "--pin=", 6) == 0) {
+      if (!setThreadPlacement(argv[i] + 6)) {
+        std::cout << "Unknown pinning: " << argv[i] + 6 << std::endl;
+        return 1;
       }
-      else {
-        newCell.orientationIndex = 0;
-        cells.orientations[0].cells.push_front(&newCell);
+    }
+    else if (strncmp(argv[i], "--fft-cpus=", 11) == 0) {
+      if (!setFFTCpus(argv[i] + 11)) {
+        std::cout << "Invalid CPU list: " << argv[i] + 11 << std::endl;
+        return 1;
+      }
+    }
+    else if (strncmp(argv[i], "--fft-threads=", 14) == 0) {
+      numFFTThreads = std::max(atoi(argv[i] + 14), 1);
+    }
+    else if (strncmp(argv[i], "--huge-pages=", 13) == 0) {
+      if (!parseHugePageSize(argv[i] + 13, &hugePageSize)) {
+        std::cout << "Unknown huge page size: " << argv[i] + 13 << std::endl;
+        return 1;
       }
-      cells.cells[i * cells.width + j] = newCell;
     }
+    else if (strncmp(argv[i], "--memory-cap=", 13) == 0) {
+      // In MiB
+      memoryCap = (size_t) atol(argv[i] + 13) * 1024 * 1024;
+    }
+    else if (strcmp(argv[i], "--numa-report") == 0) {
+      reportNuma = true;
+    }
+    else if (strcmp(argv[i], "--boundary=periodic") == 0) {
+      boundaryMode = BoundaryMode::Periodic;
+    }
+    else if (strcmp(argv[i], "--boundary=insulated") == 0) {
+      boundaryMode = BoundaryMode::Insulated;
+    }
+  }
+  setSimdLevel(simdLevel);
+  std::cout << "Using " << simdLevelToString(simdLevel) << " kernels" << std::endl;
+  // Must come before anything is planned
+  if (numFFTThreads > 1) {
+    fftw_init_threads();
+    fftw_plan_with_nthreads(numFFTThreads);
+  }
+  // Ensembles run headlessly, so there is no need for SDL
+  if (ensembleFileName != NULL) {
+    if (!isPacingSet) {
+      pacing.mode = PacingMode::AsFastAsPossible;
+    }
+    return runEnsemble(ensembleFileName, statsFileName, numSteps, boundaryMode, script, telemetryPath, exportOptions, shmName, shmSlots, pacing, cycleHistory, stopOnCycle);
+  }
+  // Declare the 2D plane of cells
+  Cells cells = createDefaultCells(SIZE, SIZE);
+  cells.boundaryMode = boundaryMode;
+  if (!checkMemoryCap(calculateSimulationMemory(&cells), "The simulation")) {
+    return 1;
+  }
+  if (SDL_Init(SDL_INIT_VIDEO) < 0 || TTF_Init() < 0) {
+    return 0;
   }
   // for (int i = 0; i < 7; i++) {
   //   for (int j = 0; j < 7; j++) {
@@ -126,17 +336,14 @@ int main (int argc, char *argv[]) {
   TTF_Font* font = TTF_OpenFont("/usr/share/fonts/TTF/FiraCode-Regular.ttf", 32);
   SDL_RenderPresent(renderer);
   bool quit = false;
-  bool paused = true;
-  bool step = false;
   SDL_Event currentEvent;
   float xOffset = 0;
   float yOffset = 0;
   float zoomFactor = 1;
-  int mousePosX;
-  int mousePosY;
-  int selectedCellX;
-  int selectedCellY;
-  int frameTime = 500;
+  int mousePosX = 0;
+  int mousePosY = 0;
+  int selectedCellX = 0;
+  int selectedCellY = 0;
   bool isSelectingRect = false;
   bool isUsingRect = false;
   int firstCornerY;
@@ -145,12 +352,55 @@ int main (int argc, char *argv[]) {
   int secondCornerX;
   int highlightedX = -1;
   int highlightedY = -1;
+  placeRows(cells.cells, sizeof(Cell) * cells.width, cells.height, cells.height);
   double* stateArray = fftw_alloc_real(cells.height * cells.width);
+  firstTouchRows(stateArray, sizeof(double) * cells.width, cells.height, cells.height);
+  std::vector<int> mainCpus = getCurrentThreadCpus();
+  pinFFTThread();
+  NeighbourCounter neighbourCounter(&cells, stateArray);
+  pinCurrentThreadToSet(mainCpus);
+  // Only filled after the FFTs are planned, as planning overwrites it
   for (int i = 0; i < cells.height * cells.width; i++) {
     stateArray[i] = 0.0;
   }
-  NeighbourCounter neighbourCounter(&cells, stateArray);
-  std::thread updateThread(updateCells, &cells, &quit, &paused, &step, &frameTime, stateArray, &neighbourCounter);
+  TileActivity tiles(&cells);
+  RenderCache renderCache = createRenderCache(renderer, cells);
+  std::cout << "Cells: " << formatBytes(sizeof(Cell) * cells.width * cells.height) << std::endl;
+  std::cout << "State array: " << formatBytes(sizeof(double) * cells.width * cells.height) << std::endl;
+  std::cout << "Render cache: " << formatBytes(sizeof(uint32_t) * renderCache.width * renderCache.height) << std::endl;
+  printArenaReport(neighbourCounter.arena, "Neighbour counter");
+  if (reportNuma) {
+    std::vector<std::vector<int>> nodes = readNumaTopology();
+    std::cout << "NUMA nodes: " << nodes.size() << std::endl;
+    reportPlacement("Cells", cells.cells, sizeof(Cell) * cells.width * cells.height);
+    reportPlacement("State array", stateArray, sizeof(double) * cells.width * cells.height);
+    reportPlacement("Neighbour array", neighbourCounter.neighbourArray, sizeof(double) * cells.width * cells.height * cells.numOrientations);
+    for (int i = 0; i < neighbourCounter.numOrientations; i++) {
+      reportPlacement("FFT output", neighbourCounter.neighbourArrays[i], sizeof(double) * neighbourCounter.fftHeight * neighbourCounter.fftWidth);
+    }
+  }
+  EditQueue* editQueue = new EditQueue();
+  FrameExporter* exporter = NULL;
+  if (exportOptions.target != NULL) {
+    exporter = new FrameExporter();
+    if (!exporter->start(exportOptions, cells.width, cells.height)) {
+      return 1;
+    }
+  }
+  FramePublisher* publisher = NULL;
+  if (shmName != NULL) {
+    publisher = new FramePublisher();
+    // Dumps loaded later are only published if they are no larger than the starting grid
+    if (!publisher->start(shmName, shmSlots, (uint64_t) cells.width * cells.height)) {
+      return 1;
+    }
+  }
+  // Starts paused
+  StepScheduler scheduler(pacing, true);
+  std::thread updateThread(updateCells, &cells, &scheduler, &neighbourCounter, &tiles, editQueue, &script, exporter, publisher, cycleHistory);
+  TelemetryServer telemetryServer;
+  TelemetryControls telemetryControls = {&scheduler, true};
+  bool isServingTelemetry = telemetryPath != NULL && telemetryServer.start(telemetryPath, telemetryControls);
   while (!quit) {
     while (SDL_PollEvent(&currentEvent) != 0) {
       if (currentEvent.type == SDL_QUIT) {
@@ -169,7 +419,7 @@ int main (int argc, char *argv[]) {
         else if (currentEvent.key.keysym.sym == SDLK_d) {
           xOffset -= 10;
         }
-        else if (currentEvent.key.keysym.sym == SDLK_r) {
+        else if (currentEvent.key.keysym.sym == SDLK_r && selectedCellX != -1 && selectedCellY != -1) {
           if (!isSelectingRect) {
             firstCornerY = selectedCellY;
             firstCornerX = selectedCellX;
@@ -196,16 +446,13 @@ int main (int argc, char *argv[]) {
           }
         }
         else if (currentEvent.key.keysym.sym == SDLK_SPACE) {
-          paused = !paused;
+          scheduler.togglePaused();
         }
         else if (currentEvent.key.keysym.sym == SDLK_PERIOD) {
-          step = true;
+          scheduler.requestStep();
         }
         else if (currentEvent.key.keysym.sym == SDLK_EQUALS) {
-          frameTime -= 50;
-          if (frameTime < 0) {
-            frameTime = 0;
-          }
+          scheduler.adjustStepPeriod(-50);
         }
         // Saves the current state to a file
         else if (currentEvent.key.keysym.sym == SDLK_F1) {
@@ -214,42 +461,48 @@ int main (int argc, char *argv[]) {
           lock.unlock();
         }
         else if (currentEvent.key.keysym.sym == SDLK_F2) {
+          Cells loadedCells;
+          if (!readCellsFromFile("cells.dmp", &loadedCells)) {
+            continue;
+          }
+          loadedCells.boundaryMode = boundaryMode;
+          if (!checkMemoryCap(calculateSimulationMemory(&loadedCells), "cells.dmp")) {
+            freeCells(loadedCells);
+            continue;
+          }
           std::unique_lock<std::mutex> lock(mu);
-          // Delete the old array so as to avoid a memory leak
-          delete[] cells.cells;
-          delete[] cells.orientations;
-          cells = readCellsFromFile("cells.dmp");
+          // Delete the old arrays so as to avoid a memory leak
+          freeCells(cells);
+          uint oldSize = cells.height * cells.width;
+          cells = loadedCells;
           SDL_SetWindowSize(window, cells.width, cells.height);
-          for (int i = 0; i < cells.height; i++) {
-            for (int j = 0; j < cells.width; j++) {
-              Cell currentCell = cells.cells[i * cells.width + j];
-              if (currentCell.type == CellType::RestingTissue) {
-                stateArray[i * cells.width + j] = 0;
-              }
-              else {
-                stateArray[i * cells.width + j] = currentCell.state;
-              }
-            }
+          placeRows(cells.cells, sizeof(Cell) * cells.width, cells.height, cells.height);
+          if (cells.height * cells.width != oldSize) {
+            fftw_free(stateArray);
+            stateArray = fftw_alloc_real(cells.height * cells.width);
+            firstTouchRows(stateArray, sizeof(double) * cells.width, cells.height, cells.height);
+            neighbourCounter.stateArray = stateArray;
           }
+          pinFFTThread();
           neighbourCounter.reinitialize();
+          pinCurrentThreadToSet(mainCpus);
+          fillStateArray(cells, stateArray);
+          tiles.reinitialize();
+          gridGeneration++;
+          telemetry.cycleLength.store(0, std::memory_order_relaxed);
+          telemetry.cyclingSimulations.store(0, std::memory_order_relaxed);
+          if (cells.width != renderCache.width || cells.height != renderCache.height) {
+            freeRenderCache(&renderCache);
+            renderCache = createRenderCache(renderer, cells);
+          }
           lock.unlock();
         }
         else if (currentEvent.key.keysym.sym == SDLK_MINUS) {
-          frameTime += 50;
+          scheduler.adjustStepPeriod(50);
         }
         // Equivalent to giving a shock to the whole heart
         else if (currentEvent.key.keysym.sym == SDLK_g) {
-          std::unique_lock<std::mutex> lock(mu);
-          for (int i = 0; i < cells.height * cells.width; i++) {
-            Cell selectedCell = cells.cells[i];
-            if (selectedCell.type == CellType::RestingTissue) {
-              continue;
-            }
-            selectedCell.state = AP_DURATION;
-            cells.cells[i] = selectedCell;
-            stateArray[i] = 0.0;
-          }
-          lock.unlock();
+          pushEdit(editQueue, &scheduler, createShockEdit());
         }
       }
       else if (currentEvent.type == SDL_KEYUP) {
@@ -260,11 +513,9 @@ int main (int argc, char *argv[]) {
       // Keep the mousePosX and mousePosY updated
       else if (currentEvent.type == SDL_MOUSEMOTION) {
         SDL_GetMouseState(&mousePosX, &mousePosY);
-        selectedCellY = (int) ((mousePosY / zoomFactor) - yOffset) % cells.height;
-        selectedCellX = (int) ((mousePosX / zoomFactor) - xOffset) % cells.width;
-        if ((mousePosX / zoomFactor) - xOffset < 0) {
-          selectedCellX--;
-        }
+        // These are -1 if the mouse is past the edge of an insulated grid
+        selectedCellY = wrapCoordinate(std::floor((mousePosY / zoomFactor) - yOffset), cells.height, cells.boundaryMode);
+        selectedCellX = wrapCoordinate(std::floor((mousePosX / zoomFactor) - xOffset), cells.width, cells.boundaryMode);
       }
       else if (currentEvent.type == SDL_MOUSEWHEEL) {
         // Calculate the selected X and Y pixel
@@ -283,84 +534,61 @@ int main (int argc, char *argv[]) {
       // When the user presses the mouse button, change the state of the cellular automata
       else if (currentEvent.type == SDL_MOUSEBUTTONDOWN) {
         SDL_GetMouseState(&mousePosX, &mousePosY);
-        std::unique_lock<std::mutex> lock(mu);
-        if (!isUsingRect) {
-          Cell* selectedCell = &cells.cells[selectedCellY * cells.width + selectedCellX];
-          if (currentEvent.button.button == SDL_BUTTON_LEFT) {
-            selectedCell->state = AP_DURATION;
-            if (selectedCell->type != CellType::RestingTissue) {
-              stateArray[selectedCellY * cells.width + selectedCellX] = selectedCell->state;
-            }
-          }
-          else if (currentEvent.button.button == SDL_BUTTON_RIGHT) {
-            if (selectedCell-> state != 0 && selectedCell->type != CellType::RestingTissue) selectedCell->state = 0;
-            if (selectedCell->type != CellType::RestingTissue) {
-              stateArray[selectedCellY * cells.width + selectedCellX] = selectedCell->state;
-            }
-          }
-          else if (currentEvent.button.button == SDL_BUTTON_MIDDLE) {
-            if (selectedCell->type == CellType::RestingTissue) {
-              selectedCell->type = CellType::Tissue;
-              stateArray[selectedCellY * cells.width + selectedCellX] = selectedCell->state;
-            }
-            else if (selectedCell->type == CellType::Tissue) {
-              selectedCell->type = CellType::RestingTissue;
-              stateArray[selectedCellY * cells.width + selectedCellX] = 0;
-            }
-          }
+        EditType editType;
+        if (currentEvent.button.button == SDL_BUTTON_LEFT) {
+          editType = EditType::Stimulate;
+        }
+        else if (currentEvent.button.button == SDL_BUTTON_RIGHT) {
+          editType = EditType::Clear;
+        }
+        else if (currentEvent.button.button == SDL_BUTTON_MIDDLE) {
+          editType = EditType::ToggleResting;
         }
         else {
+          continue;
+        }
+        if (!isUsingRect && selectedCellX != -1 && selectedCellY != -1) {
+          pushEdit(editQueue, &scheduler, createCellEdit(editType, selectedCellY, selectedCellX));
+        }
+        else if (isUsingRect) {
           if (firstCornerY > secondCornerY) {
             std::swap(firstCornerY, secondCornerY);
           }
           if (firstCornerX > secondCornerX) {
             std::swap(firstCornerX, secondCornerX);
           }
-          for (int i = firstCornerY; i < secondCornerY; i++) {
-            for (int j = firstCornerX; j < secondCornerX; j++) {
-              Cell* selectedCell = &cells.cells[i * cells.width + j];
-              if (currentEvent.button.button == SDL_BUTTON_LEFT) {
-                selectedCell->state = AP_DURATION;
-                if (selectedCell->type != CellType::RestingTissue) {
-                  stateArray[i * cells.width + j] = selectedCell->state;
-                }
-              }
-              else if (currentEvent.button.button == SDL_BUTTON_RIGHT) {
-                if (selectedCell-> state != 0 && selectedCell->type != CellType::RestingTissue) selectedCell->state = 0;
-                if (selectedCell->type != CellType::RestingTissue) {
-                  stateArray[i * cells.width + j] = selectedCell->state;
-                }
-              }
-              else if (currentEvent.button.button == SDL_BUTTON_MIDDLE) {
-                if (selectedCell->type == CellType::RestingTissue) {
-                  selectedCell->type = CellType::Tissue;
-                  stateArray[i * cells.width + j] = selectedCell->state;
-                }
-                else if (selectedCell->type == CellType::Tissue) {
-                  selectedCell->type = CellType::RestingTissue;
-                  stateArray[i * cells.width + j] = 0;
-                }
-              }
-            }
-          }
+          pushEdit(editQueue, &scheduler, createAreaEdit(editType, firstCornerY, firstCornerX, secondCornerY, secondCornerX));
         }
         // TODO: change tissue type on shift-right click (or similar)
-        lock.unlock();
       }
     }
     std::unique_lock<std::mutex> lock(mu);
-    renderCells(cells, renderer, font, xOffset, yOffset, zoomFactor, selectedCellY, selectedCellX, firstCornerY, secondCornerY, firstCornerX, secondCornerX);
+    renderCells(cells, &renderCache, &tiles, renderer, font, xOffset, yOffset, zoomFactor, selectedCellY, selectedCellX, firstCornerY, secondCornerY, firstCornerX, secondCornerX);
     lock.unlock();
     // Use fewer CPU cycles if paused
-    if (paused) {
+    if (scheduler.isPaused()) {
       SDL_Delay(25);
     }
     else {
       SDL_Delay(10);
     }
   }
+  scheduler.quit();
   updateThread.join();
-  delete[] cells.cells;
+  if (exporter != NULL) {
+    exporter->finish();
+    delete exporter;
+  }
+  if (publisher != NULL) {
+    publisher->finish();
+    delete publisher;
+  }
+  if (isServingTelemetry) {
+    telemetryServer.stop();
+  }
+  delete editQueue;
+  freeRenderCache(&renderCache);
+  freeCells(cells);
   fftw_free(stateArray);
   TTF_CloseFont(font);
   SDL_DestroyWindow(window);
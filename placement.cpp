@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "placement.h"
+#include "tiles.h"
+
+// From linux/mempolicy.h, so that libnuma is not needed
+#define MPOL_PREFERRED 1
+#define MPOL_MF_MOVE (1 << 1)
+
+ThreadPlacement createDefaultThreadPlacement() {
+  ThreadPlacement placement;
+  placement.pinThreads = false;
+  placement.numBands = 1;
+  placement.workerCpus.assign(NUM_THREADS, -1);
+  placement.bandNodes.assign(NUM_THREADS, -1);
+  placement.workerBands.assign(NUM_THREADS, 0);
+  return placement;
+}
+
+ThreadPlacement threadPlacement = createDefaultThreadPlacement();
+
+bool parseCpuList(const char* text, std::vector<int>* cpus) {
+  cpus->clear();
+  const char* current = text;
+  while (*current != '\0' && *current != '\n') {
+    int first;
+    int last;
+    int length;
+    if (sscanf(current, "%d-%d%n", &first, &last, &length) == 2) {
+      current += length;
+    }
+    else if (sscanf(current, "%d%n", &first, &length) == 1) {
+      last = first;
+      current += length;
+    }
+    else {
+      return false;
+    }
+    if (first < 0 || last < first || last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus->push_back(cpu);
+    }
+    if (*current == ',') {
+      current++;
+    }
+    else if (*current != '\0' && *current != '\n') {
+      return false;
+    }
+  }
+  return !cpus->empty();
+}
+
+std::vector<std::vector<int>> readNumaTopology() {
+  std::vector<std::vector<int>> nodes;
+  for (int node = 0; ; node++) {
+    std::ifstream cpuListStream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (!cpuListStream.is_open()) {
+      break;
+    }
+    std::string cpuList;
+    std::getline(cpuListStream, cpuList);
+    // Memory-only nodes have no CPUs, but still keep their number
+    std::vector<int> cpus;
+    parseCpuList(cpuList.c_str(), &cpus);
+    nodes.push_back(cpus);
+  }
+  if (nodes.empty()) {
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < std::thread::hardware_concurrency(); cpu++) {
+      cpus.push_back(cpu);
+    }
+    nodes.push_back(cpus);
+  }
+  return nodes;
+}
+
+// The node a CPU belongs to, or -1 if it is not in the topology
+int findCpuNode(const std::vector<std::vector<int>>& nodes, int cpu) {
+  for (int node = 0; node < nodes.size(); node++) {
+    if (std::find(nodes[node].begin(), nodes[node].end(), cpu) != nodes[node].end()) {
+      return node;
+    }
+  }
+  return -1;
+}
+
+bool setFFTCpus(const char* cpuList) {
+  if (!parseCpuList(cpuList, &threadPlacement.fftCpus)) {
+    return false;
+  }
+  threadPlacement.allCpus.clear();
+  for (const std::vector<int>& nodeCpus : readNumaTopology()) {
+    threadPlacement.allCpus.insert(threadPlacement.allCpus.end(), nodeCpus.begin(), nodeCpus.end());
+  }
+  return true;
+}
+
+bool setThreadPlacement(const char* mode) {
+  std::vector<std::vector<int>> nodes = readNumaTopology();
+  ThreadPlacement placement = createDefaultThreadPlacement();
+  placement.fftCpus = threadPlacement.fftCpus;
+  placement.allCpus = threadPlacement.allCpus;
+  if (strcmp(mode, "none") == 0) {
+    threadPlacement = placement;
+    return true;
+  }
+  std::vector<int> cpus;
+  if (strcmp(mode, "compact") == 0) {
+    for (int node = 0; node < nodes.size(); node++) {
+      cpus.insert(cpus.end(), nodes[node].begin(), nodes[node].end());
+    }
+  }
+  else if (strcmp(mode, "scatter") == 0) {
+    bool addedCpu = true;
+    for (int i = 0; addedCpu; i++) {
+      addedCpu = false;
+      for (int node = 0; node < nodes.size(); node++) {
+        if (i < nodes[node].size()) {
+          cpus.push_back(nodes[node][i]);
+          addedCpu = true;
+        }
+      }
+    }
+  }
+  else if (!parseCpuList(mode, &cpus)) {
+    return false;
+  }
+  if (cpus.empty()) {
+    return false;
+  }
+  placement.pinThreads = true;
+  placement.numBands = 0;
+  std::map<int, uint> nodeBands;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    // If there are fewer CPUs than workers, then they are shared
+    int cpu = cpus[i % cpus.size()];
+    int node = findCpuNode(nodes, cpu);
+    if (node == -1) {
+      std::cout << "CPU " << cpu << " is not online" << std::endl;
+      return false;
+    }
+    if (nodeBands.count(node) == 0) {
+      nodeBands[node] = placement.numBands;
+      placement.bandNodes[placement.numBands] = node;
+      placement.numBands++;
+    }
+    placement.workerCpus[i] = cpu;
+    placement.workerBands[i] = nodeBands[node];
+  }
+  threadPlacement = placement;
+  std::cout << "Pinned step workers to CPUs";
+  for (int i = 0; i < NUM_THREADS; i++) {
+    std::cout << " " << threadPlacement.workerCpus[i];
+  }
+  std::cout << " across " << threadPlacement.numBands << " NUMA node(s)" << std::endl;
+  return true;
+}
+
+std::vector<int> getCurrentThreadCpus() {
+  std::vector<int> cpus;
+  cpu_set_t cpuSet;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &cpuSet)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  return cpus;
+}
+
+void pinCurrentThreadToSet(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return;
+  }
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &cpuSet);
+  }
+  int error = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+  if (error != 0) {
+    std::cout << "Could not pin thread: " << strerror(error) << std::endl;
+  }
+}
+
+void pinWorker(uint worker) {
+  if (threadPlacement.pinThreads) {
+    pinCurrentThreadToSet(std::vector<int>(1, threadPlacement.workerCpus[worker]));
+  }
+  else if (!threadPlacement.fftCpus.empty()) {
+    // Otherwise the worker would inherit the FFT thread's CPUs
+    pinCurrentThreadToSet(threadPlacement.allCpus);
+  }
+}
+
+void pinFFTThread() {
+  if (!threadPlacement.fftCpus.empty()) {
+    pinCurrentThreadToSet(threadPlacement.fftCpus);
+  }
+}
+
+uint bandStartTileRow(uint band, uint tilesY) {
+  return (band * tilesY) / threadPlacement.numBands;
+}
+
+// The range of a band, rounded to whole pages so that the bands do not overlap. Pages which straddle two bands
+// go to the later one
+void findBandPages(void* buffer, size_t rowBytes, uint numRows, uint gridHeight, uint band, uintptr_t* start, uintptr_t* end) {
+  uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  uint tilesY = (gridHeight + TILE_SIZE - 1) / TILE_SIZE;
+  uint firstRow = std::min(bandStartTileRow(band, tilesY) * TILE_SIZE, numRows);
+  uint lastRow = std::min(bandStartTileRow(band + 1, tilesY) * TILE_SIZE, numRows);
+  // Any rows past the grid (such as zero padding) go with the last band
+  if (band == threadPlacement.numBands - 1) {
+    lastRow = numRows;
+  }
+  *start = ((uintptr_t) buffer + firstRow * rowBytes) & ~(pageSize - 1);
+  *end = ((uintptr_t) buffer + lastRow * rowBytes) & ~(pageSize - 1);
+  if (band == threadPlacement.numBands - 1) {
+    *end = ((uintptr_t) buffer + lastRow * rowBytes + pageSize - 1) & ~(pageSize - 1);
+  }
+}
+
+void placeRows(void* buffer, size_t rowBytes, uint numRows, uint gridHeight) {
+  if (!threadPlacement.pinThreads) {
+    return;
+  }
+  for (uint band = 0; band < threadPlacement.numBands; band++) {
+    int node = threadPlacement.bandNodes[band];
+    uintptr_t start;
+    uintptr_t end;
+    findBandPages(buffer, rowBytes, numRows, gridHeight, band, &start, &end);
+    if (node < 0 || end <= start) {
+      continue;
+    }
+    unsigned long nodeMask[16] = {0};
+    nodeMask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, nodeMask, sizeof(nodeMask) * 8, MPOL_MF_MOVE) != 0) {
+      std::cout << "Could not place memory on node " << node << ": " << strerror(errno) << std::endl;
+      return;
+    }
+  }
+}
+
+// Zeroes the rows of a band, from one of the band's workers
+void touchBand(void* buffer, size_t rowBytes, uint numRows, uint gridHeight, uint band, uint worker) {
+  pinWorker(worker);
+  uintptr_t start;
+  uintptr_t end;
+  findBandPages(buffer, rowBytes, numRows, gridHeight, band, &start, &end);
+  start = std::max(start, (uintptr_t) buffer);
+  end = std::min(end, (uintptr_t) buffer + rowBytes * numRows);
+  if (end > start) {
+    memset((void*) start, 0, end - start);
+  }
+}
+
+void firstTouchRows(void* buffer, size_t rowBytes, uint numRows, uint gridHeight) {
+  if (!threadPlacement.pinThreads) {
+    memset(buffer, 0, rowBytes * numRows);
+    return;
+  }
+  placeRows(buffer, rowBytes, numRows, gridHeight);
+  std::vector<std::thread> threads;
+  for (uint band = 0; band < threadPlacement.numBands; band++) {
+    // Any worker on the band's node will do
+    for (uint i = 0; i < NUM_THREADS; i++) {
+      if (threadPlacement.workerBands[i] == band) {
+        threads.push_back(std::thread(touchBand, buffer, rowBytes, numRows, gridHeight, band, i));
+        break;
+      }
+    }
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+void reportPlacement(const char* name, void* buffer, size_t bytes) {
+  uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t) buffer & ~(pageSize - 1);
+  size_t numPages = ((uintptr_t) buffer + bytes - start + pageSize - 1) / pageSize;
+  std::vector<void*> pages(numPages);
+  std::vector<int> status(numPages);
+  for (size_t i = 0; i < numPages; i++) {
+    pages[i] = (void*) (start + i * pageSize);
+  }
+  // With no target nodes, move_pages just reports which node each page is on
+  if (syscall(SYS_move_pages, 0, numPages, pages.data(), NULL, status.data(), 0) != 0) {
+    std::cout << name << ": placement unavailable (" << strerror(errno) << ")" << std::endl;
+    return;
+  }
+  std::map<int, size_t> pagesPerNode;
+  for (int node : status) {
+    pagesPerNode[node]++;
+  }
+  std::cout << name << " (" << numPages << " pages):";
+  for (auto entry : pagesPerNode) {
+    if (entry.first >= 0) {
+      std::cout << " node " << entry.first << ": " << entry.second;
+    }
+    else if (entry.first == -ENOENT) {
+      std::cout << " untouched: " << entry.second;
+    }
+    else {
+      std::cout << " unknown: " << entry.second;
+    }
+  }
+  std::cout << std::endl;
+}
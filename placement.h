@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <sys/types.h>
+#include <vector>
+
+// Where the step workers and FFT threads run, and so where the memory they work on should be placed
+struct ThreadPlacement {
+  bool pinThreads;
+  // The CPU each step worker is pinned to
+  std::vector<int> workerCpus;
+  // The grid is split into bands of whole tile rows, one for each NUMA node the workers run on. Each band's memory
+  // is placed on its node, and its tiles are only updated by the workers on that node
+  uint numBands;
+  std::vector<int> bandNodes;
+  std::vector<uint> workerBands;
+  // The CPUs the thread which runs the FFTs (and so the threads FFTW starts from it) may use, if not empty
+  std::vector<int> fftCpus;
+  // Every online CPU, which unpinned workers are given when fftCpus is set, as they would otherwise inherit the FFT
+  // thread's CPUs. Read once with fftCpus, rather than by every worker
+  std::vector<int> allCpus;
+};
+
+// Unpinned, with the whole grid as one band
+extern ThreadPlacement threadPlacement;
+
+// The CPUs of each NUMA node, read from /sys/devices/system/node (a single node, if that is unavailable)
+std::vector<std::vector<int>> readNumaTopology();
+
+// Parses a list of CPUs such as 0-3,8,10-11, returning false if it is invalid
+bool parseCpuList(const char* text, std::vector<int>* cpus);
+
+// Restricts the thread which runs the FFTs to a list of CPUs, returning false if the list is invalid
+bool setFFTCpus(const char* cpuList);
+
+// Pins the workers according to mode, which is none, compact (filling one node at a time), scatter (alternating
+// between nodes) or an explicit list of CPUs. Returns false if the mode is invalid
+bool setThreadPlacement(const char* mode);
+
+std::vector<int> getCurrentThreadCpus();
+
+void pinCurrentThreadToSet(const std::vector<int>& cpus);
+
+// Called at the start of each step worker
+void pinWorker(uint worker);
+
+// Called from the thread which runs the FFTs. FFTW starts its threads when plans are first measured, so this
+// must also be called around planning
+void pinFFTThread();
+
+// The first tile row of a band, or the number of tile rows for band numBands
+uint bandStartTileRow(uint band, uint tilesY);
+
+// Moves each band of rows of a buffer laid out like the grid to its band's node, and sets the policy so that
+// any pages which have not been touched yet are placed there too
+void placeRows(void* buffer, size_t rowBytes, uint numRows, uint gridHeight);
+
+// Zeroes a freshly allocated buffer laid out like the grid, with each band first touched by one of its own workers
+void firstTouchRows(void* buffer, size_t rowBytes, uint numRows, uint gridHeight);
+
+// Prints how many of a buffer's pages are on each node
+void reportPlacement(const char* name, void* buffer, size_t bytes);
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include "scheduler.h"
+
+Pacing createPacing(PacingMode mode, double value) {
+  Pacing pacing;
+  pacing.mode = mode;
+  pacing.stepsPerSecond = mode == PacingMode::FixedRate ? value : 0;
+  pacing.realTimeRatio = mode == PacingMode::RealTime ? value : 1;
+  // With the default model, an action potential and its refractory period (12 steps) last about 300ms
+  pacing.simulatedMsPerStep = 25;
+  return pacing;
+}
+
+bool parsePacing(const char* text, Pacing* pacing) {
+  char* end;
+  if (strcmp(text, "max") == 0) {
+    pacing->mode = PacingMode::AsFastAsPossible;
+    return true;
+  }
+  if (strncmp(text, "realtime", 8) == 0) {
+    double ratio = 1;
+    if (text[8] == ':') {
+      ratio = strtod(text + 9, &end);
+      if (end == text + 9 || *end != '\0' || ratio <= 0) {
+        return false;
+      }
+    }
+    else if (text[8] != '\0') {
+      return false;
+    }
+    pacing->mode = PacingMode::RealTime;
+    pacing->realTimeRatio = ratio;
+    return true;
+  }
+  double stepsPerSecond = strtod(text, &end);
+  if (end == text || *end != '\0' || stepsPerSecond <= 0) {
+    return false;
+  }
+  pacing->mode = PacingMode::FixedRate;
+  pacing->stepsPerSecond = stepsPerSecond;
+  return true;
+}
+
+std::string pacingToString(Pacing pacing) {
+  std::ostringstream text;
+  if (pacing.mode == PacingMode::AsFastAsPossible) {
+    text << "max";
+  }
+  else if (pacing.mode == PacingMode::FixedRate) {
+    text << pacing.stepsPerSecond;
+  }
+  else {
+    text << "realtime:" << pacing.realTimeRatio;
+  }
+  return text.str();
+}
+
+StepScheduler::StepScheduler(Pacing pacing, bool isPaused) {
+  this->pacing = pacing;
+  paused = isPaused;
+  isStepRequested = false;
+  isWoken = false;
+  isQuitting = false;
+  numLateSteps = 0;
+  runningTime = std::chrono::steady_clock::duration::zero();
+  runningSteps = 0;
+  setPeriod();
+  nextDeadline = std::chrono::steady_clock::now();
+  isWindowOpen = false;
+}
+
+void StepScheduler::setPeriod() {
+  double seconds = 0;
+  if (pacing.mode == PacingMode::FixedRate) {
+    seconds = 1 / pacing.stepsPerSecond;
+  }
+  else if (pacing.mode == PacingMode::RealTime) {
+    seconds = pacing.simulatedMsPerStep / 1000 / pacing.realTimeRatio;
+  }
+  period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+// Adds the current window to the totals, with the next one opening at the next step
+void StepScheduler::closeWindow(std::chrono::steady_clock::time_point now) {
+  if (isWindowOpen) {
+    runningTime += now - windowStart;
+    runningSteps += windowSteps;
+  }
+  isWindowOpen = false;
+}
+
+SchedulerEvent StepScheduler::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    if (isQuitting) {
+      return SchedulerEvent::Quit;
+    }
+    if (isWoken) {
+      isWoken = false;
+      return SchedulerEvent::WokenUp;
+    }
+    if (paused) {
+      if (isStepRequested) {
+        isStepRequested = false;
+        return SchedulerEvent::TakeStep;
+      }
+      changed.wait(lock);
+      continue;
+    }
+    if (period == std::chrono::steady_clock::duration::zero()) {
+      return SchedulerEvent::TakeStep;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= nextDeadline) {
+      nextDeadline += period;
+      // A step which overran by less than a period is caught up on, but rather than a burst of steps after a long
+      // stall, the deadlines start again from now
+      if (nextDeadline <= now) {
+        numLateSteps++;
+        nextDeadline = now + period;
+      }
+      return SchedulerEvent::TakeStep;
+    }
+    changed.wait_until(lock, nextDeadline);
+  }
+}
+
+void StepScheduler::stepTaken() {
+  std::unique_lock<std::mutex> lock(mutex);
+  // Single steps while paused do not count towards the rate
+  if (paused) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  if (!isWindowOpen) {
+    isWindowOpen = true;
+    windowStart = now;
+    windowSteps = 0;
+    return;
+  }
+  windowSteps++;
+  auto elapsed = now - windowStart;
+  if (elapsed < std::chrono::seconds(RATE_REPORT_SECONDS)) {
+    return;
+  }
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << "Achieved " << windowSteps / seconds << " steps/s";
+  if (period != std::chrono::steady_clock::duration::zero()) {
+    std::cout << " (target " << 1 / std::chrono::duration<double>(period).count() << " steps/s, " << numLateSteps << " late steps so far)";
+  }
+  std::cout << std::endl;
+  closeWindow(now);
+  // This step ends one window and starts the next
+  isWindowOpen = true;
+  windowStart = now;
+  windowSteps = 0;
+}
+
+void StepScheduler::wake() {
+  std::unique_lock<std::mutex> lock(mutex);
+  isWoken = true;
+  lock.unlock();
+  changed.notify_all();
+}
+
+void StepScheduler::quit() {
+  std::unique_lock<std::mutex> lock(mutex);
+  isQuitting = true;
+  lock.unlock();
+  changed.notify_all();
+}
+
+bool StepScheduler::isPaused() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return paused;
+}
+
+void StepScheduler::setPaused(bool isPaused) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (paused == isPaused) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+  closeWindow(now);
+  if (!isPaused) {
+    // The first step after resuming is due straight away, and takes the place of any single step not yet taken
+    nextDeadline = now;
+    isStepRequested = false;
+  }
+  paused = isPaused;
+  lock.unlock();
+  changed.notify_all();
+}
+
+void StepScheduler::togglePaused() {
+  setPaused(!isPaused());
+}
+
+bool StepScheduler::requestStep() {
+  std::unique_lock<std::mutex> lock(mutex);
+  // While running, the step would be taken on top of the paced ones
+  if (!paused) {
+    return false;
+  }
+  isStepRequested = true;
+  lock.unlock();
+  changed.notify_all();
+  return true;
+}
+
+Pacing StepScheduler::getPacing() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return pacing;
+}
+
+void StepScheduler::setPacing(Pacing pacing) {
+  std::unique_lock<std::mutex> lock(mutex);
+  auto now = std::chrono::steady_clock::now();
+  auto lastDeadline = period == std::chrono::steady_clock::duration::zero() ? now : nextDeadline - period;
+  this->pacing = pacing;
+  setPeriod();
+  // Counts from the last deadline, so that speeding up takes effect immediately
+  nextDeadline = std::max(lastDeadline + period, now);
+  // The rate is reported separately for each target
+  closeWindow(now);
+  lock.unlock();
+  changed.notify_all();
+}
+
+void StepScheduler::adjustStepPeriod(int milliseconds) {
+  std::unique_lock<std::mutex> lock(mutex);
+  double periodMs = std::chrono::duration<double, std::milli>(period).count() + milliseconds;
+  lock.unlock();
+  Pacing newPacing = getPacing();
+  if (periodMs <= 0) {
+    newPacing.mode = PacingMode::AsFastAsPossible;
+  }
+  else {
+    newPacing.mode = PacingMode::FixedRate;
+    newPacing.stepsPerSecond = 1000 / periodMs;
+  }
+  setPacing(newPacing);
+}
+
+double StepScheduler::targetStepsPerSecond() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return period == std::chrono::steady_clock::duration::zero() ? 0 : 1 / std::chrono::duration<double>(period).count();
+}
+
+uint64_t StepScheduler::lateSteps() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return numLateSteps;
+}
+
+void StepScheduler::reportOverallRate() {
+  std::unique_lock<std::mutex> lock(mutex);
+  auto time = runningTime;
+  uint64_t steps = runningSteps;
+  if (isWindowOpen) {
+    time += std::chrono::steady_clock::now() - windowStart;
+    steps += windowSteps;
+  }
+  double seconds = std::chrono::duration<double>(time).count();
+  std::cout << "Achieved " << (seconds > 0 ? steps / seconds : 0.0) << " steps/s overall while running";
+  if (period != std::chrono::steady_clock::duration::zero()) {
+    std::cout << " (target " << 1 / std::chrono::duration<double>(period).count() << " steps/s, " << numLateSteps << " late steps)";
+  }
+  std::cout << std::endl;
+}
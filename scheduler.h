@@ -0,0 +1,93 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// How often the achieved step rate is reported while running
+#define RATE_REPORT_SECONDS 5
+
+enum PacingMode {
+  // Each step starts as soon as the last one finishes
+  AsFastAsPossible,
+  // A fixed number of steps per second
+  FixedRate,
+  // Simulated time passes at a multiple of real time, with each step being simulatedMsPerStep of simulated time
+  RealTime
+};
+
+struct Pacing {
+  PacingMode mode;
+  double stepsPerSecond;
+  double realTimeRatio;
+  // How much time one step simulates, in milliseconds
+  double simulatedMsPerStep;
+};
+
+Pacing createPacing(PacingMode mode, double value);
+
+// Parses "max", a number of steps per second, or "realtime[:ratio]" into pacing, leaving its simulatedMsPerStep alone.
+// Returns false if the text is not one of these
+bool parsePacing(const char* text, Pacing* pacing);
+
+std::string pacingToString(Pacing pacing);
+
+// What the simulation thread should do after waiting on the scheduler
+enum SchedulerEvent {
+  TakeStep,
+  // Something needs handling between steps (such as queued edits), but no step is due yet
+  WokenUp,
+  Quit
+};
+
+// Decides when the simulation thread takes each step. Steps are due on a fixed grid of deadlines (each one period
+// after the last, rather than after the last step finished), so the rate does not drift however long the steps take.
+// Every change (pausing, stepping, changing the pace, queueing edits) wakes the simulation thread straight away
+class StepScheduler {
+  public:
+    StepScheduler(Pacing pacing, bool isPaused);
+    // Blocks the simulation thread until a step is due, it is woken up, or it should quit
+    SchedulerEvent wait();
+    // Called by the simulation thread after each step, to keep track of the rate actually achieved
+    void stepTaken();
+    // Wakes the simulation thread to handle something between steps
+    void wake();
+    void quit();
+    bool isPaused();
+    void setPaused(bool isPaused);
+    void togglePaused();
+    // Takes a single step, while paused. Returns false (ignoring the request) while running
+    bool requestStep();
+    Pacing getPacing();
+    void setPacing(Pacing pacing);
+    // Changes the time between steps by the given number of milliseconds (for the +/- keys), switching to a fixed rate
+    void adjustStepPeriod(int milliseconds);
+    // 0 when going as fast as possible
+    double targetStepsPerSecond();
+    uint64_t lateSteps();
+    // Prints the rate achieved since the scheduler was created, against the target
+    void reportOverallRate();
+  private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    Pacing pacing;
+    // 0 when going as fast as possible
+    std::chrono::steady_clock::duration period;
+    std::chrono::steady_clock::time_point nextDeadline;
+    bool paused;
+    bool isStepRequested;
+    bool isWoken;
+    bool isQuitting;
+    // Steps which started more than a whole period after their deadline, so could not be caught up
+    uint64_t numLateSteps;
+    // The rate achieved while running (rather than paused) is measured over windows of RATE_REPORT_SECONDS, each
+    // starting when a step finishes and counting the steps finished after it
+    bool isWindowOpen;
+    std::chrono::steady_clock::time_point windowStart;
+    uint64_t windowSteps;
+    std::chrono::steady_clock::duration runningTime;
+    uint64_t runningSteps;
+    void setPeriod();
+    void closeWindow(std::chrono::steady_clock::time_point now);
+};
@@ -0,0 +1,250 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "scheduler.h"
+#include "telemetry.h"
+
+Telemetry telemetry;
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+  double microseconds = nanoseconds / 1000.0;
+  int bucket = 0;
+  if (microseconds >= 1.0) {
+    bucket = std::min((int) (std::log2(microseconds) * LATENCY_BUCKETS_PER_DOUBLING) + 1, LATENCY_BUCKETS - 1);
+  }
+  counts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::percentile(double fraction) {
+  // The counts may change while this runs, which only makes the result slightly stale
+  uint64_t snapshot[LATENCY_BUCKETS];
+  uint64_t total = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    snapshot[i] = counts[i].load(std::memory_order_relaxed);
+    total += snapshot[i];
+  }
+  if (total == 0) {
+    return 0.0;
+  }
+  uint64_t target = std::ceil(fraction * total);
+  uint64_t seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += snapshot[i];
+    if (seen >= target && snapshot[i] != 0) {
+      if (i == 0) {
+        return 0.5;
+      }
+      // The geometric middle of the bucket
+      return std::exp2((i - 0.5) / LATENCY_BUCKETS_PER_DOUBLING);
+    }
+  }
+  return 0.0;
+}
+
+const char* telemetryStageToString(TelemetryStage stage) {
+  switch (stage) {
+    case TelemetryStage::EditStage:
+      return "edits";
+    case TelemetryStage::FFTStage:
+      return "fft";
+    case TelemetryStage::UpdateStage:
+      return "update";
+    default:
+      return "step";
+  }
+}
+
+std::chrono::steady_clock::time_point recordStage(TelemetryStage stage, std::chrono::steady_clock::time_point start) {
+  auto end = std::chrono::steady_clock::now();
+  telemetry.latencies[stage].record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  return end;
+}
+
+// Removes the socket at path, if there is one. Returns false if something other than a socket is there, which is
+// left alone
+bool removeSocket(const char* path) {
+  struct stat status;
+  if (lstat(path, &status) != 0) {
+    return errno == ENOENT;
+  }
+  if (!S_ISSOCK(status.st_mode)) {
+    return false;
+  }
+  unlink(path);
+  return true;
+}
+
+bool TelemetryServer::start(const char* path, TelemetryControls controls) {
+  this->path = path;
+  this->controls = controls;
+  stopping.store(false);
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    std::cout << "Telemetry socket path is too long: " << path << std::endl;
+    return false;
+  }
+  strcpy(address.sun_path, path);
+  // A socket left behind by an earlier run would stop bind from working
+  if (!removeSocket(path)) {
+    std::cout << "Not serving telemetry on " << path << ", as something other than a socket is already there" << std::endl;
+    return false;
+  }
+  listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenSocket < 0 || bind(listenSocket, (sockaddr*) &address, sizeof(address)) != 0 || listen(listenSocket, 4) != 0) {
+    std::cout << "Could not create telemetry socket " << path << ": " << strerror(errno) << std::endl;
+    if (listenSocket >= 0) {
+      close(listenSocket);
+    }
+    return false;
+  }
+  startTime = std::chrono::steady_clock::now();
+  lastTime = startTime;
+  lastSteps = 0;
+  thread = std::thread(&TelemetryServer::serve, this);
+  std::cout << "Serving telemetry on " << path << std::endl;
+  return true;
+}
+
+void TelemetryServer::stop() {
+  stopping.store(true);
+  thread.join();
+  close(listenSocket);
+  removeSocket(path);
+}
+
+void TelemetryServer::serve() {
+  pollfd listenPoll = {listenSocket, POLLIN, 0};
+  while (!stopping.load()) {
+    // Wakes up regularly, so that stop does not have to wait for a client
+    if (poll(&listenPoll, 1, 100) <= 0) {
+      continue;
+    }
+    int clientSocket = accept(listenSocket, NULL, NULL);
+    if (clientSocket >= 0) {
+      serveClient(clientSocket);
+      close(clientSocket);
+    }
+  }
+}
+
+void TelemetryServer::serveClient(int clientSocket) {
+  pollfd clientPoll = {clientSocket, POLLIN, 0};
+  std::string buffer;
+  char received[256];
+  while (!stopping.load()) {
+    if (poll(&clientPoll, 1, 100) <= 0) {
+      continue;
+    }
+    ssize_t length = read(clientSocket, received, sizeof(received));
+    if (length <= 0) {
+      return;
+    }
+    buffer.append(received, length);
+    size_t lineEnd;
+    while ((lineEnd = buffer.find('\n')) != std::string::npos) {
+      std::string response = handleCommand(buffer.substr(0, lineEnd));
+      buffer.erase(0, lineEnd + 1);
+      if (write(clientSocket, response.data(), response.size()) < 0) {
+        return;
+      }
+    }
+  }
+}
+
+std::string TelemetryServer::handleCommand(const std::string& command) {
+  std::istringstream commandStream(command);
+  std::string name;
+  commandStream >> name;
+  if (name == "metrics") {
+    return formatMetrics();
+  }
+  if (name == "pause" || name == "resume") {
+    controls.scheduler->setPaused(name == "pause");
+    return "ok\n";
+  }
+  if (name == "step") {
+    if (!controls.scheduler->requestStep()) {
+      return "error: step only works while paused\n";
+    }
+    return "ok\n";
+  }
+  if (name == "checkpoint") {
+    if (!controls.canCheckpoint) {
+      return "error: checkpoint is not supported in this mode\n";
+    }
+    telemetry.checkpointRequested.store(true);
+    // Checkpoints are saved between steps, which may be a long way off
+    controls.scheduler->wake();
+    return "ok\n";
+  }
+  if (name == "frametime") {
+    double frameTime;
+    if (!(commandStream >> frameTime) || frameTime < 0) {
+      return "error: frametime needs a number of milliseconds\n";
+    }
+    Pacing pacing = controls.scheduler->getPacing();
+    pacing.mode = frameTime == 0 ? PacingMode::AsFastAsPossible : PacingMode::FixedRate;
+    pacing.stepsPerSecond = frameTime == 0 ? 0 : 1000 / frameTime;
+    controls.scheduler->setPacing(pacing);
+    return "ok\n";
+  }
+  if (name == "pace") {
+    std::string text;
+    Pacing pacing = controls.scheduler->getPacing();
+    if (!(commandStream >> text) || !parsePacing(text.c_str(), &pacing)) {
+      return "error: pace needs \"max\", a number of steps per second, or \"realtime[:ratio]\"\n";
+    }
+    controls.scheduler->setPacing(pacing);
+    return "ok\n";
+  }
+  return "error: unknown command " + name + "\n";
+}
+
+std::string TelemetryServer::formatMetrics() {
+  auto now = std::chrono::steady_clock::now();
+  uint64_t steps = telemetry.stepsTaken.load(std::memory_order_relaxed);
+  double sinceLast = std::chrono::duration<double>(now - lastTime).count();
+  double sinceStart = std::chrono::duration<double>(now - startTime).count();
+  std::ostringstream metrics;
+  metrics << "step " << steps << "\n";
+  metrics << "steps_per_second " << (sinceLast > 0 ? (steps - lastSteps) / sinceLast : 0.0) << "\n";
+  metrics << "average_steps_per_second " << (sinceStart > 0 ? steps / sinceStart : 0.0) << "\n";
+  metrics << "active_cells " << telemetry.activeCells.load(std::memory_order_relaxed) << "\n";
+  metrics << "cycle_length " << telemetry.cycleLength.load(std::memory_order_relaxed) << "\n";
+  metrics << "cycling_simulations " << telemetry.cyclingSimulations.load(std::memory_order_relaxed) << "\n";
+  lastSteps = steps;
+  lastTime = now;
+  // The second field of statm is the resident set size, in pages
+  std::ifstream statmStream("/proc/self/statm");
+  size_t virtualPages;
+  size_t residentPages;
+  if (statmStream >> virtualPages >> residentPages) {
+    metrics << "memory_resident_bytes " << residentPages * sysconf(_SC_PAGESIZE) << "\n";
+  }
+  metrics << "memory_arena_bytes " << telemetry.arenaBytes.load(std::memory_order_relaxed) << "\n";
+  metrics << "paused " << controls.scheduler->isPaused() << "\n";
+  // 0 when going as fast as possible
+  metrics << "target_steps_per_second " << controls.scheduler->targetStepsPerSecond() << "\n";
+  metrics << "late_steps " << controls.scheduler->lateSteps() << "\n";
+  const double quantiles[3] = {0.5, 0.9, 0.99};
+  for (int stage = 0; stage < TelemetryStage::NUM_STAGES; stage++) {
+    for (double quantile : quantiles) {
+      metrics << "latency_us{stage=\"" << telemetryStageToString((TelemetryStage) stage) << "\",quantile=\"" << quantile << "\"} "
+        << telemetry.latencies[stage].percentile(quantile) << "\n";
+    }
+  }
+  metrics << "\n";
+  return metrics.str();
+}
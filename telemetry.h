@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Latencies are bucketed logarithmically, with 4 buckets per doubling from 1 microsecond (up to about an hour),
+// so the percentiles are accurate to within about 10%
+#define LATENCY_BUCKETS 128
+#define LATENCY_BUCKETS_PER_DOUBLING 4
+
+// A histogram which any thread can record into without locking
+class LatencyHistogram {
+  public:
+    std::atomic<uint64_t> counts[LATENCY_BUCKETS];
+    LatencyHistogram() {
+      for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        counts[i].store(0, std::memory_order_relaxed);
+      }
+    }
+    void record(uint64_t nanoseconds);
+    // The latency (in microseconds) which the given fraction of recorded latencies are below, or 0 if there are none
+    double percentile(double fraction);
+};
+
+// The parts of a step which are timed separately
+enum TelemetryStage {
+  // Applying queued edits
+  EditStage,
+  // Counting neighbours with the FFTs
+  FFTStage,
+  // Updating the cells from the neighbour counts
+  UpdateStage,
+  // The whole step, which is counting and updating
+  StepStage,
+  NUM_STAGES
+};
+
+// Metrics which the simulation writes as it runs, and the telemetry server reads, without either locking
+struct Telemetry {
+  std::atomic<uint64_t> stepsTaken;
+  // Cells which count towards their neighbours, in the tiles updated by the last step (or every member of an ensemble)
+  std::atomic<uint64_t> activeCells;
+  std::atomic<uint64_t> arenaBytes;
+  // The period of the cycle the simulation is confirmed to be in, or 0 if it is not in one. In an ensemble, the
+  // shortest cycle of any member which is confirmed to be in one
+  std::atomic<uint64_t> cycleLength;
+  // How many simulations (0 or 1, or up to the number of members of an ensemble) are confirmed to be in a cycle
+  std::atomic<uint64_t> cyclingSimulations;
+  // Set by the checkpoint command, and cleared by the simulation thread once it has saved the cells
+  std::atomic<bool> checkpointRequested;
+  LatencyHistogram latencies[NUM_STAGES];
+};
+
+extern Telemetry telemetry;
+
+const char* telemetryStageToString(TelemetryStage stage);
+
+// Records how long a stage took since start, and returns the current time
+std::chrono::steady_clock::time_point recordStage(TelemetryStage stage, std::chrono::steady_clock::time_point start);
+
+class StepScheduler;
+
+// The simulation's controls, which the server's commands change
+struct TelemetryControls {
+  StepScheduler* scheduler;
+  // Saving the cells is not supported for ensembles
+  bool canCheckpoint;
+};
+
+// Serves the telemetry over a Unix domain socket, one client at a time. Each line sent by a client is a command:
+//   metrics             the current metrics, one "name value" per line, followed by an empty line
+//   pause | resume      pauses or resumes the simulation
+//   step                takes a single step while paused
+//   checkpoint          saves the cells to cells.dmp at the end of the current step
+//   frametime <ms>      sets the time per step, or goes as fast as possible for 0
+//   pace <pacing>       sets the pacing, as "max", a number of steps per second, or "realtime[:ratio]"
+// Every other command is answered with "ok" or "error: <reason>"
+class TelemetryServer {
+  public:
+    // Starts serving on the socket at path, returning false if it could not be created
+    bool start(const char* path, TelemetryControls controls);
+    void stop();
+  private:
+    const char* path;
+    int listenSocket;
+    TelemetryControls controls;
+    std::atomic<bool> stopping;
+    std::thread thread;
+    // For working out the steps per second between one metrics request and the next
+    uint64_t lastSteps;
+    std::chrono::steady_clock::time_point lastTime;
+    std::chrono::steady_clock::time_point startTime;
+    void serve();
+    void serveClient(int clientSocket);
+    std::string handleCommand(const std::string& command);
+    std::string formatMetrics();
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "cells.h"
+// Width and height (in cells) of the tiles that activity is tracked over
+#define TILE_SIZE 64
+
+// Tracks which square tiles of the grid have any activity, so that the updates can skip quiescent regions,
+// and only the tiles which may have changed need to be redrawn
+class TileActivity {
+  public:
+    Cells* cells;
+    uint tilesX;
+    uint tilesY;
+    // 1 if any cell in the tile was not quiescent (see CellModel::quiescent) after it was last updated
+    uint8_t* active;
+    // 1 if the tile may have changed since it was last drawn
+    uint8_t* dirty;
+    // The sum of hashCell over the tile's cells, as of the last time it was updated
+    uint64_t* hashes;
+    TileActivity(Cells* cells) {
+      this->cells = cells;
+      allocateArrays();
+    }
+    ~TileActivity() {
+      freeArrays();
+    }
+    // Must be called whenever the grid is replaced, and marks everything as active
+    void reinitialize() {
+      if ((cells->width + TILE_SIZE - 1) / TILE_SIZE != tilesX || (cells->height + TILE_SIZE - 1) / TILE_SIZE != tilesY) {
+        freeArrays();
+        allocateArrays();
+      }
+      markAllActive();
+    }
+    void markAllActive() {
+      memset(active, 1, tilesX * tilesY);
+      memset(dirty, 1, tilesX * tilesY);
+    }
+    // Must be called whenever a cell is changed outside of a step
+    void markCellActive(int i, int j) {
+      uint tile = (i / TILE_SIZE) * tilesX + (j / TILE_SIZE);
+      active[tile] = 1;
+      dirty[tile] = 1;
+    }
+    // Must be called whenever the cells in the rows [firstRow, lastRow) and columns [firstColumn, lastColumn)
+    // are changed outside of a step
+    void markAreaActive(int firstRow, int firstColumn, int lastRow, int lastColumn) {
+      for (int i = firstRow / TILE_SIZE; i <= (lastRow - 1) / TILE_SIZE; i++) {
+        memset(&active[i * tilesX + firstColumn / TILE_SIZE], 1, (lastColumn - 1) / TILE_SIZE - firstColumn / TILE_SIZE + 1);
+        memset(&dirty[i * tilesX + firstColumn / TILE_SIZE], 1, (lastColumn - 1) / TILE_SIZE - firstColumn / TILE_SIZE + 1);
+      }
+    }
+    // The hash of the whole grid as of the last step, which is only complete once every tile has been updated
+    // (as they all are by the first step after reinitializing)
+    uint64_t gridHash() {
+      uint64_t hash = 0;
+      for (uint i = 0; i < tilesX * tilesY; i++) {
+        hash += hashes[i];
+      }
+      return hash;
+    }
+    // Fills tilesToUpdate with every tile which is active, or close enough to an active tile for the neighbour
+    // counts to be affected by it, and returns how many there are
+    uint findTilesToUpdate(uint* tilesToUpdate) {
+      int reach = (SEARCH_RADIUS / 2 + TILE_SIZE - 1) / TILE_SIZE;
+      bool isPeriodic = cells->boundaryMode == BoundaryMode::Periodic;
+      // When wrapping around, a partial tile at the edge brings the tiles on either side of it closer together
+      if (isPeriodic && (cells->width % TILE_SIZE != 0 || cells->height % TILE_SIZE != 0)) {
+        reach++;
+      }
+      memset(needsUpdate, 0, tilesX * tilesY);
+      for (int i = 0; i < tilesY; i++) {
+        for (int j = 0; j < tilesX; j++) {
+          if (!active[i * tilesX + j]) {
+            continue;
+          }
+          for (int k = i - reach; k <= i + reach; k++) {
+            for (int l = j - reach; l <= j + reach; l++) {
+              int tileI = wrapCoordinate(k, tilesY, cells->boundaryMode);
+              int tileJ = wrapCoordinate(l, tilesX, cells->boundaryMode);
+              if (tileI != -1 && tileJ != -1) {
+                needsUpdate[tileI * tilesX + tileJ] = 1;
+              }
+            }
+          }
+        }
+      }
+      uint numTiles = 0;
+      for (uint i = 0; i < tilesX * tilesY; i++) {
+        if (needsUpdate[i]) {
+          tilesToUpdate[numTiles] = i;
+          numTiles++;
+        }
+      }
+      return numTiles;
+    }
+  private:
+    uint8_t* needsUpdate;
+    void allocateArrays() {
+      tilesX = (cells->width + TILE_SIZE - 1) / TILE_SIZE;
+      tilesY = (cells->height + TILE_SIZE - 1) / TILE_SIZE;
+      active = new uint8_t[tilesX * tilesY];
+      dirty = new uint8_t[tilesX * tilesY];
+      needsUpdate = new uint8_t[tilesX * tilesY];
+      hashes = new uint64_t[tilesX * tilesY]();
+      markAllActive();
+    }
+    void freeArrays() {
+      delete[] active;
+      delete[] dirty;
+      delete[] needsUpdate;
+      delete[] hashes;
+    }
+};